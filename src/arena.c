@@ -0,0 +1,75 @@
+#include <stdlib.h>
+#include "arena.h"
+
+#define ARENA_ALIGN _Alignof(max_align_t)
+#define ROUND_UP(size) (((size) + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1))
+#define ARENA_HEADER ROUND_UP(sizeof(arena_block_t))
+
+void arena_init(arena_t *self)
+{
+    self->blocks = NULL;
+    self->current = NULL;
+    self->used = 0;
+    pthread_mutex_init(&self->mutex, NULL);
+}
+
+void *arena_alloc(arena_t *self, size_t size)
+{
+    size = ROUND_UP(size > 0 ? size : 1);
+
+    pthread_mutex_lock(&self->mutex);
+    while(self->current == NULL || self->used + size > self->current->size)
+    {
+        /* Move on to the next block kept from an earlier run, or add one before it: */
+        arena_block_t *next = self->current != NULL ? self->current->next : self->blocks;
+        if(next == NULL || next->size < size)
+        {
+            size_t block_size = size > ARENA_BLOCK_SIZE ? size : ARENA_BLOCK_SIZE;
+            arena_block_t *block = (arena_block_t *)malloc(ARENA_HEADER + block_size);
+            if(block == NULL)
+            {
+                pthread_mutex_unlock(&self->mutex);
+                return NULL;
+            }
+            block->size = block_size;
+            block->next = next;
+            if(self->current != NULL)
+            {
+                self->current->next = block;
+            }
+            else
+            {
+                self->blocks = block;
+            }
+            next = block;
+        }
+        self->current = next;
+        self->used = 0;
+    }
+
+    void *memory = (char *)self->current + ARENA_HEADER + self->used;
+    self->used += size;
+    pthread_mutex_unlock(&self->mutex);
+
+    return memory;
+}
+
+void arena_reset(arena_t *self)
+{
+    pthread_mutex_lock(&self->mutex);
+    self->current = NULL;
+    self->used = 0;
+    pthread_mutex_unlock(&self->mutex);
+}
+
+void arena_destroy(arena_t *self)
+{
+    while(self->blocks != NULL)
+    {
+        arena_block_t *next = self->blocks->next;
+        free(self->blocks);
+        self->blocks = next;
+    }
+    self->current = NULL;
+    pthread_mutex_destroy(&self->mutex);
+}
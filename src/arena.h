@@ -0,0 +1,54 @@
+#ifndef  ARENA_H
+#define  ARENA_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+    // Bytes of each block an arena carves allocations from, unless one needs more
+#define ARENA_BLOCK_SIZE (256 * 1024)
+
+typedef struct arena_block_t arena_block_t;
+
+typedef struct arena_block_t
+{
+    arena_block_t *next;
+    size_t size;        // bytes after the header
+} arena_block_t;
+
+/**
+ * @brief Memory for the objects of one run, handed out by bumping a
+ * pointer through a few large blocks and released all together. Objects
+ * are never freed one at a time, reuse them through free lists of their
+ * own type instead (see slab_init_arena()). Allocating takes a mutex, so
+ * allocate in chunks from threads that churn.
+ */
+typedef struct arena_t
+{
+    arena_block_t *blocks;      // in the order they are filled
+    arena_block_t *current;
+    size_t used;                // bytes of the current block handed out
+    pthread_mutex_t mutex;
+} arena_t;
+
+void arena_init(arena_t *self);
+
+/**
+ * @brief Allocate memory aligned as malloc() would.
+ *
+ * @returns NULL if out of memory.
+ */
+void *arena_alloc(arena_t *self, size_t size);
+
+/**
+ * @brief Release everything allocated, keeping the blocks for the next run
+ * so it doesn't call malloc() again.
+ */
+void arena_reset(arena_t *self);
+
+/**
+ * @brief Release everything allocated, and the blocks.
+ */
+void arena_destroy(arena_t *self);
+
+#endif //ARENA_H
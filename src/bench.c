@@ -0,0 +1,732 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include "htab.h"
+#include "slab.h"
+#include "skiplist.h"
+#include "spsc_ring.h"
+#include "linked_list.h"
+#include "thread_pool.h"
+#include "timing_manager.h"
+
+/* Micro-benchmarks of the core data structures, reporting ns/op and percentiles.
+   Thread pool throughput percentiles are each task's wait from submission to start,
+   thread_pool batch sends them BENCH_BATCH at a time and waits on a task group,
+   thread_pool emergency is that of emergency tasks sent behind a backlog of simulation ones.
+   Usage: bench.out [size] [submitting threads] [pool threads] */
+
+#define BENCH_SIZE 100000
+#define BENCH_THREADS 1
+    // Operations timed together for one percentile sample, so the clock
+    // itself doesn't dominate short operations
+#define BENCH_SAMPLE_OPS 16
+#define BENCH_MAX_THREADS 64
+    // Tasks sent one at a time to measure dispatch latency
+#define BENCH_LATENCY_TASKS 10000
+    // Run time of each simulation task in the backlog emergency tasks jump
+#define BENCH_BACKLOG_TASK_NS 1000
+    // Emergency tasks sent behind the backlog, at least, whatever the size
+#define BENCH_EMERGENCY_TASKS 1000
+    // Tasks per submission in the batch benchmark
+#define BENCH_BATCH 64
+    // Keys per htab_find_batch() call, as a plate reload looks them up
+#define BENCH_FIND_BATCH 256
+    // Slots of the ring queue benchmarked, as an entrance queue
+#define BENCH_RING_SIZE 256
+    // Simulation runs the size is split between, the size of each car, and the slots of a run's slab up front
+#define BENCH_RUNS 100
+#define BENCH_CAR_SIZE 96
+#define BENCH_RUN_SLOTS 128
+
+static double bench_now_ns(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1e9 + now.tv_nsec;
+}
+
+static int bench_compare_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * @brief Print the mean over every operation, then percentiles of the samples
+ * (each in ns per operation). Sorts the samples.
+ */
+static void bench_report(const char *name, double total_ns, size_t ops, double *samples, size_t num_samples)
+{
+    qsort(samples, num_samples, sizeof(double), bench_compare_double);
+    printf("%-24s %10zu ops %9.1f ns/op", name, ops, total_ns / (ops ? ops : 1));
+    if(num_samples > 0)
+    {
+        printf("   p50 %8.1f  p90 %8.1f  p99 %8.1f  p99.9 %8.1f  max %9.1f",
+            samples[num_samples / 2], samples[num_samples * 90 / 100], samples[num_samples * 99 / 100],
+            samples[num_samples * 999 / 1000], samples[num_samples - 1]);
+    }
+    printf("\n");
+}
+
+/**
+ * @brief Write plate i, in the simulator's 3 digits then 3 letters format.
+ */
+static void bench_plate(size_t i, char plate[HTAB_KEY_LENGTH + 1])
+{
+    plate[0] = '0' + i / 100 % 10;
+    plate[1] = '0' + i / 10 % 10;
+    plate[2] = '0' + i % 10;
+    plate[3] = 'A' + i / 1000 % 26;
+    plate[4] = 'A' + i / 26000 % 26;
+    plate[5] = 'A' + i / 676000 % 26;
+    plate[6] = '\0';
+}
+
+//////////////////// Hash table:
+
+/**
+ * @brief Look up size random plates, from the first `size` plates (all in
+ * the table) for hits, or the next `size` plates for misses.
+ */
+static void bench_htab_find(htab_t *h, size_t size, bool hit, double *samples)
+{
+    char (*plates)[HTAB_KEY_LENGTH + 1] = malloc(size * sizeof(*plates));
+    unsigned seed = hit ? 1 : 2;
+    for(size_t i = 0; i < size; ++i)
+    {
+        bench_plate(rand_r(&seed) % size + (hit ? 0 : size), plates[i]);
+    }
+
+    size_t found = 0, num_samples = 0;
+    double start = bench_now_ns();
+    for(size_t i = 0; i < size; i += BENCH_SAMPLE_OPS)
+    {
+        size_t ops = size - i < BENCH_SAMPLE_OPS ? size - i : BENCH_SAMPLE_OPS;
+        double sample_start = bench_now_ns();
+        for(size_t k = 0; k < ops; ++k)
+        {
+            found += htab_find(h, plates[i + k]) != NULL;
+        }
+        samples[num_samples++] = (bench_now_ns() - sample_start) / ops;
+    }
+    double total = bench_now_ns() - start;
+
+    bench_report(hit ? "htab_find hit" : "htab_find miss", total, size, samples, num_samples);
+    if(found != (hit ? size : 0))
+    {
+        fprintf(stderr, "htab_find found %zu of %zu\n", found, hit ? size : 0);
+    }
+    free(plates);
+}
+
+/**
+ * @brief Look up the same plates as bench_htab_find(), BENCH_FIND_BATCH at a
+ * time with htab_find_batch(). Each sample is one call.
+ */
+static void bench_htab_find_batch(const htab_t *h, size_t size, bool hit, double *samples)
+{
+    uint64_t *ids = (uint64_t *)malloc(size * sizeof(uint64_t));
+    int values[BENCH_FIND_BATCH];
+    char plate[HTAB_KEY_LENGTH + 1];
+    unsigned seed = hit ? 1 : 2;
+    for(size_t i = 0; i < size; ++i)
+    {
+        bench_plate(rand_r(&seed) % size + (hit ? 0 : size), plate);
+        ids[i] = htab_key(plate);
+    }
+
+    size_t found = 0, num_samples = 0;
+    double start = bench_now_ns();
+    for(size_t i = 0; i < size; i += BENCH_FIND_BATCH)
+    {
+        size_t ops = size - i < BENCH_FIND_BATCH ? size - i : BENCH_FIND_BATCH;
+        double sample_start = bench_now_ns();
+        found += htab_find_batch(h, &ids[i], ops, values);
+        samples[num_samples++] = (bench_now_ns() - sample_start) / ops;
+    }
+    double total = bench_now_ns() - start;
+
+    bench_report(hit ? "htab_find_batch hit" : "htab_find_batch miss", total, size, samples, num_samples);
+    if(found != (hit ? size : 0))
+    {
+        fprintf(stderr, "htab_find_batch found %zu of %zu\n", found, hit ? size : 0);
+    }
+    free(ids);
+}
+
+static void bench_htab(size_t size, double *samples)
+{
+    htab_t h;
+    char plate[HTAB_KEY_LENGTH + 1];
+
+    /* Start small, so adds include growing the table: */
+    htab_init(&h, 1);
+    double start = bench_now_ns();
+    for(size_t i = 0; i < size; ++i)
+    {
+        bench_plate(i, plate);
+        htab_add(&h, plate, (int)i + 1);
+    }
+    bench_report("htab_add", bench_now_ns() - start, size, samples, 0);
+
+    bench_htab_find(&h, size, true, samples);
+    bench_htab_find_batch(&h, size, true, samples);
+    bench_htab_find(&h, size, false, samples);
+    bench_htab_find_batch(&h, size, false, samples);
+
+    htab_destroy(&h);
+}
+
+//////////////////// Skip list:
+
+static void bench_skiplist(size_t size, double *samples)
+{
+    epoch_t epoch;
+    epoch_init(&epoch);
+    int reader = epoch_register(&epoch);
+    skiplist_t list;
+    skiplist_init(&list, &epoch);
+    char plate[HTAB_KEY_LENGTH + 1];
+
+    size_t num_samples = 0;
+    double start = bench_now_ns();
+    for(size_t i = 0; i < size; i += BENCH_SAMPLE_OPS)
+    {
+        size_t ops = size - i < BENCH_SAMPLE_OPS ? size - i : BENCH_SAMPLE_OPS;
+        double sample_start = bench_now_ns();
+        for(size_t k = 0; k < ops; ++k)
+        {
+            bench_plate(i + k, plate);
+            skiplist_insert(&list, skiplist_key(plate, HTAB_KEY_LENGTH), (void *)(i + k + 1));
+        }
+        samples[num_samples++] = (bench_now_ns() - sample_start) / ops;
+    }
+    bench_report("skiplist_insert", bench_now_ns() - start, size, samples, num_samples);
+
+    /* Random hits, each in its own read section as a reader thread would: */
+    unsigned seed = 1;
+    size_t found = 0;
+    num_samples = 0;
+    start = bench_now_ns();
+    for(size_t i = 0; i < size; i += BENCH_SAMPLE_OPS)
+    {
+        size_t ops = size - i < BENCH_SAMPLE_OPS ? size - i : BENCH_SAMPLE_OPS;
+        double sample_start = bench_now_ns();
+        for(size_t k = 0; k < ops; ++k)
+        {
+            bench_plate(rand_r(&seed) % size, plate);
+            epoch_enter(&epoch, reader);
+            found += skiplist_find(&list, skiplist_key(plate, HTAB_KEY_LENGTH)) != NULL;
+            epoch_exit(&epoch, reader);
+        }
+        samples[num_samples++] = (bench_now_ns() - sample_start) / ops;
+    }
+    bench_report("skiplist_find", bench_now_ns() - start, size, samples, num_samples);
+
+    /* Every item in plate order: */
+    size_t visited = 0;
+    uint64_t previous = 0;
+    bool ordered = true;
+    start = bench_now_ns();
+    epoch_enter(&epoch, reader);
+    for(skiplist_node_t *node = skiplist_seek(&list, 0); node != NULL; node = skiplist_next(node))
+    {
+        ordered = ordered && node->key > previous;
+        previous = node->key;
+        ++visited;
+    }
+    epoch_exit(&epoch, reader);
+    bench_report("skiplist_scan", bench_now_ns() - start, size, samples, 0);
+
+    num_samples = 0;
+    start = bench_now_ns();
+    for(size_t i = 0; i < size; i += BENCH_SAMPLE_OPS)
+    {
+        size_t ops = size - i < BENCH_SAMPLE_OPS ? size - i : BENCH_SAMPLE_OPS;
+        double sample_start = bench_now_ns();
+        for(size_t k = 0; k < ops; ++k)
+        {
+            bench_plate(i + k, plate);
+            skiplist_delete(&list, skiplist_key(plate, HTAB_KEY_LENGTH), NULL);
+        }
+        samples[num_samples++] = (bench_now_ns() - sample_start) / ops;
+    }
+    bench_report("skiplist_delete", bench_now_ns() - start, size, samples, num_samples);
+
+    if(found != size || visited != size || !ordered || list.count != 0)
+    {
+        fprintf(stderr, "skiplist found %zu, visited %zu of %zu, %s\n", found, visited, size,
+            ordered ? "in order" : "out of order");
+    }
+    skiplist_destroy(&list);
+}
+
+//////////////////// Simulation runs:
+
+/**
+ * @brief Back to back runs, as a soak test does: each sets up a car slab and
+ * plate index, churns cars through them and tears them down. On an arena,
+ * teardown is one reset and later runs reuse its blocks.
+ */
+static void bench_runs(size_t size, double *samples, bool use_arena)
+{
+    size_t cars = size / BENCH_RUNS > 0 ? size / BENCH_RUNS : 1;
+    arena_t arena;
+    arena_init(&arena);
+    char plate[HTAB_KEY_LENGTH + 1];
+
+    double start = bench_now_ns();
+    for(int run = 0; run < BENCH_RUNS; ++run)
+    {
+        slab_t slab;
+        skiplist_t index;
+        slab_init_arena(&slab, use_arena ? &arena : NULL, BENCH_CAR_SIZE, BENCH_RUN_SLOTS);
+        skiplist_init_arena(&index, NULL, use_arena ? &arena : NULL);
+
+        /* Half the cars leave as the rest arrive, so the index holds about half: */
+        for(size_t i = 0; i < cars; ++i)
+        {
+            bench_plate(i, plate);
+            char *car = (char *)slab_alloc(&slab);
+            memcpy(car, plate, HTAB_KEY_LENGTH);
+            skiplist_insert(&index, skiplist_key(plate, HTAB_KEY_LENGTH), car);
+            if(i % 2 == 1)
+            {
+                bench_plate(i / 2, plate);
+                slab_free(&slab, skiplist_delete(&index, skiplist_key(plate, HTAB_KEY_LENGTH), NULL));
+            }
+        }
+
+        skiplist_destroy(&index);
+        slab_destroy(&slab);
+        if(use_arena)
+        {
+            arena_reset(&arena);
+        }
+    }
+    bench_report(use_arena ? "runs arena" : "runs malloc", bench_now_ns() - start, cars * BENCH_RUNS, samples, 0);
+
+    arena_destroy(&arena);
+}
+
+//////////////////// Linked list:
+
+static void bench_llist(size_t size, double *samples)
+{
+    list_t *list;
+    llist_init(&list, NULL, NULL);
+
+    size_t num_samples = 0;
+    double start = bench_now_ns();
+    for(size_t i = 0; i < size; i += BENCH_SAMPLE_OPS)
+    {
+        size_t ops = size - i < BENCH_SAMPLE_OPS ? size - i : BENCH_SAMPLE_OPS;
+        double sample_start = bench_now_ns();
+        for(size_t k = 0; k < ops; ++k)
+        {
+            size_t data = i + k;
+            llist_append(list, &data, sizeof(data));
+        }
+        samples[num_samples++] = (bench_now_ns() - sample_start) / ops;
+    }
+    bench_report("llist_append", bench_now_ns() - start, size, samples, num_samples);
+
+    num_samples = 0;
+    start = bench_now_ns();
+    for(size_t i = 0; i < size; i += BENCH_SAMPLE_OPS)
+    {
+        size_t ops = size - i < BENCH_SAMPLE_OPS ? size - i : BENCH_SAMPLE_OPS;
+        double sample_start = bench_now_ns();
+        for(size_t k = 0; k < ops; ++k)
+        {
+            node_t *node = llist_pop(list);
+            llist_delete_dangling_node(node, NULL);
+        }
+        samples[num_samples++] = (bench_now_ns() - sample_start) / ops;
+    }
+    bench_report("llist_pop", bench_now_ns() - start, size, samples, num_samples);
+
+    llist_close(list);
+}
+
+//////////////////// Ring queue:
+
+/* format of the producer side of the ring benchmark. */
+typedef struct bench_ring_t
+{
+    spsc_ring_t *ring;
+    size_t count;
+} bench_ring_t;
+
+static void *bench_ring_producer(void *args)
+{
+    bench_ring_t *producer = (bench_ring_t *)args;
+    for(size_t i = 1; i <= producer->count; ++i)
+    {
+        spsc_ring_push(producer->ring, (void *)i);
+    }
+    spsc_ring_close(producer->ring);
+    return NULL;
+}
+
+/* One thread pushing, this one popping, as the car generator feeds an entrance: */
+static void bench_spsc_ring(size_t size, double *samples)
+{
+    spsc_ring_t ring;
+    spsc_ring_init(&ring, BENCH_RING_SIZE);
+    bench_ring_t producer = { &ring, size };
+    pthread_t thread;
+
+    size_t popped = 0;
+    bool ordered = true;
+    double start = bench_now_ns();
+    pthread_create(&thread, NULL, bench_ring_producer, &producer);
+    for(void *item; (item = spsc_ring_pop(&ring)) != NULL;)
+    {
+        ordered = ordered && (size_t)item == ++popped;
+    }
+    double total = bench_now_ns() - start;
+    pthread_join(thread, NULL);
+
+    bench_report("spsc_ring", total, size, samples, 0);
+    if(popped != size || !ordered)
+    {
+        fprintf(stderr, "spsc_ring popped %zu of %zu, %s\n", popped, size, ordered ? "in order" : "out of order");
+    }
+    spsc_ring_destroy(&ring);
+}
+
+//////////////////// Thread pool:
+
+/* format of the timestamps of a single benchmark task. */
+typedef struct bench_task_t
+{
+    double submitted;
+    double started;
+    _Atomic size_t *done;
+} bench_task_t;
+
+typedef struct bench_submitter_t
+{
+    thread_pool_t *pool;
+    bench_task_t *tasks;
+    size_t count;
+} bench_submitter_t;
+
+/* format of a backlog of simulation tasks, submitted until stopped. */
+typedef struct bench_backlog_t
+{
+    thread_pool_t *pool;
+    _Atomic bool stop;
+    _Atomic size_t submitted;
+    _Atomic size_t done;
+} bench_backlog_t;
+
+static void *bench_task(void *args)
+{
+    bench_task_t *task = (bench_task_t *)args;
+    task->started = bench_now_ns();
+    atomic_fetch_add_explicit(task->done, 1, memory_order_release);
+    return NULL;
+}
+
+static void *bench_submit_loop(void *args)
+{
+    bench_submitter_t *submitter = (bench_submitter_t *)args;
+    for(size_t i = 0; i < submitter->count; ++i)
+    {
+        submitter->tasks[i].submitted = bench_now_ns();
+        thread_pool_add_request(submitter->pool, bench_task, &submitter->tasks[i]);
+    }
+    return NULL;
+}
+
+/* Simulation work, busy for BENCH_BACKLOG_TASK_NS: */
+static void *bench_backlog_task(void *args)
+{
+    bench_backlog_t *backlog = (bench_backlog_t *)args;
+    double start = bench_now_ns();
+    while(bench_now_ns() - start < BENCH_BACKLOG_TASK_NS)
+    {
+    }
+    atomic_fetch_add_explicit(&backlog->done, 1, memory_order_release);
+    return NULL;
+}
+
+/* Keep the simulation ring full, the pool makes this wait while it is: */
+static void *bench_backlog_loop(void *args)
+{
+    bench_backlog_t *backlog = (bench_backlog_t *)args;
+    while(!atomic_load(&backlog->stop))
+    {
+        thread_pool_add_request(backlog->pool, bench_backlog_task, backlog);
+        atomic_fetch_add(&backlog->submitted, 1);
+    }
+    return NULL;
+}
+
+/* Submit every task from inside the pool, onto the submitting worker's own queue: */
+static void *bench_fan_out_task(void *args)
+{
+    bench_submitter_t *submitter = (bench_submitter_t *)args;
+    bench_submit_loop(submitter);
+    return NULL;
+}
+
+static void bench_pool_metrics(const char *name, uint64_t requests, const thread_pool_percentiles_t *p)
+{
+    printf("%-24s %10" PRIu64 " ops %14s   p50 %8" PRIu64 "  p90 %8" PRIu64 "  p99 %8" PRIu64 "  p99.9 %8" PRIu64 "  max %9" PRIu64 "\n",
+        name, requests, "", p->p50, p->p90, p->p99, p->p999, p->max);
+}
+
+static void bench_thread_pool(size_t size, int num_threads, int pool_threads, double *samples)
+{
+    thread_pool_t *pool = (thread_pool_t *)aligned_alloc(_Alignof(thread_pool_t), sizeof(thread_pool_t));
+    bench_task_t *tasks = (bench_task_t *)calloc(size, sizeof(bench_task_t));
+    _Atomic size_t done = 0;
+    for(size_t i = 0; i < size; ++i)
+    {
+        tasks[i].done = &done;
+    }
+    thread_pool_init_sized(pool, pool_threads, pool_threads);
+
+    /* Split the tasks between the submitting threads: */
+    pthread_t threads[BENCH_MAX_THREADS];
+    bench_submitter_t submitters[BENCH_MAX_THREADS];
+    double start = bench_now_ns();
+    for(int t = 0; t < num_threads; ++t)
+    {
+        submitters[t].pool = pool;
+        submitters[t].tasks = &tasks[size * t / num_threads];
+        submitters[t].count = size * (t + 1) / num_threads - size * t / num_threads;
+        pthread_create(&threads[t], NULL, bench_submit_loop, &submitters[t]);
+    }
+    for(int t = 0; t < num_threads; ++t)
+    {
+        pthread_join(threads[t], NULL);
+    }
+    while(atomic_load_explicit(&done, memory_order_acquire) < size)
+    {
+        sched_yield();
+    }
+    double total = bench_now_ns() - start;
+
+    /* Time from submission to start, including waiting behind the backlog: */
+    for(size_t i = 0; i < size; ++i)
+    {
+        samples[i] = tasks[i].started - tasks[i].submitted;
+    }
+    bench_report("thread_pool throughput", total, size, samples, size);
+
+    /* Same again, but submitted by a task running on a worker: */
+    atomic_store(&done, 0);
+    submitters[0].tasks = tasks;
+    submitters[0].count = size;
+    start = bench_now_ns();
+    thread_pool_add_request(pool, bench_fan_out_task, &submitters[0]);
+    while(atomic_load_explicit(&done, memory_order_acquire) < size)
+    {
+        sched_yield();
+    }
+    total = bench_now_ns() - start;
+    for(size_t i = 0; i < size; ++i)
+    {
+        samples[i] = tasks[i].started - tasks[i].submitted;
+    }
+    bench_report("thread_pool fan-out", total, size, samples, size);
+
+    /* Dispatch latency to an idle pool, one task at a time: */
+    size_t latency_tasks = size < BENCH_LATENCY_TASKS ? size : BENCH_LATENCY_TASKS;
+    atomic_store(&done, 0);
+    start = bench_now_ns();
+    for(size_t i = 0; i < latency_tasks; ++i)
+    {
+        tasks[i].submitted = bench_now_ns();
+        thread_pool_add_request(pool, bench_task, &tasks[i]);
+        while(atomic_load_explicit(&done, memory_order_acquire) <= i)
+        {
+            sched_yield();
+        }
+        samples[i] = tasks[i].started - tasks[i].submitted;
+    }
+    bench_report("thread_pool dispatch", bench_now_ns() - start, latency_tasks, samples, latency_tasks);
+
+    /* Same as the throughput run, but a batch per submission, waited on as a group: */
+    thread_pool_task_t batch[BENCH_BATCH];
+    thread_pool_group_t group;
+    thread_pool_group_init(&group);
+    start = bench_now_ns();
+    for(size_t first = 0; first < size; first += BENCH_BATCH)
+    {
+        size_t count = size - first < BENCH_BATCH ? size - first : BENCH_BATCH;
+        double submitted = bench_now_ns();
+        for(size_t i = 0; i < count; ++i)
+        {
+            tasks[first + i].submitted = submitted;
+            batch[i].func = bench_task;
+            batch[i].args = &tasks[first + i];
+        }
+        thread_pool_add_batch(pool, THREAD_POOL_SIMULATION, batch, count, &group);
+    }
+    thread_pool_group_wait(&group);
+    total = bench_now_ns() - start;
+    for(size_t i = 0; i < size; ++i)
+    {
+        samples[i] = tasks[i].started - tasks[i].submitted;
+    }
+    bench_report("thread_pool batch", total, size, samples, size);
+
+    /* Emergency tasks one at a time, while another thread keeps the simulation
+       ring full. Wait for enough to fill it and busy every worker first: */
+    bench_backlog_t backlog = { .pool = pool };
+    pthread_create(&threads[0], NULL, bench_backlog_loop, &backlog);
+    while(atomic_load(&backlog.submitted) < THREAD_POOL_RING_SIZE + (size_t)pool_threads)
+    {
+        sched_yield();
+    }
+    size_t urgent = latency_tasks > BENCH_EMERGENCY_TASKS ? latency_tasks : BENCH_EMERGENCY_TASKS;
+    bench_task_t *urgent_tasks = (bench_task_t *)calloc(urgent, sizeof(bench_task_t));
+    atomic_store(&done, 0);
+    start = bench_now_ns();
+    for(size_t i = 0; i < urgent; ++i)
+    {
+        urgent_tasks[i].done = &done;
+        urgent_tasks[i].submitted = bench_now_ns();
+        thread_pool_add_request_priority(pool, THREAD_POOL_EMERGENCY, bench_task, &urgent_tasks[i]);
+        while(atomic_load_explicit(&done, memory_order_acquire) <= i)
+        {
+            sched_yield();
+        }
+        samples[i] = urgent_tasks[i].started - urgent_tasks[i].submitted;
+    }
+    bench_report("thread_pool emergency", bench_now_ns() - start, urgent, samples, urgent);
+    atomic_store(&backlog.stop, true);
+    pthread_join(threads[0], NULL);
+    while(atomic_load_explicit(&backlog.done, memory_order_acquire) < atomic_load(&backlog.submitted))
+    {
+        sched_yield();
+    }
+    free(urgent_tasks);
+
+    /* The pool's own view of everything above, if built with METRICS=1: */
+    thread_pool_metrics_t metrics;
+    if(thread_pool_metrics(pool, &metrics))
+    {
+        bench_pool_metrics("thread_pool metrics wait", metrics.requests, &metrics.wait);
+        bench_pool_metrics("  emergency", metrics.requests_by_priority[THREAD_POOL_EMERGENCY],
+            &metrics.wait_by_priority[THREAD_POOL_EMERGENCY]);
+        bench_pool_metrics("  simulation", metrics.requests_by_priority[THREAD_POOL_SIMULATION],
+            &metrics.wait_by_priority[THREAD_POOL_SIMULATION]);
+        bench_pool_metrics("thread_pool metrics run", metrics.requests, &metrics.run);
+        printf("%-24s %9.1f%% busy, %.1f ms busy, %.1f ms idle\n", "thread_pool utilisation",
+            metrics.utilisation * 100, metrics.busy_ns / 1e6, metrics.idle_ns / 1e6);
+    }
+
+    thread_pool_close(pool);
+
+    free(tasks);
+    free(pool);
+}
+
+//////////////////// Timing manager:
+
+static void *bench_timer_fired(void *args)
+{
+    return NULL;
+}
+
+/**
+ * @brief Add size timers, all outstanding at once with delays of up to an
+ * hour, then cancel them in random order.
+ */
+static void bench_timing_manager(size_t size, double *samples)
+{
+    timing_manager_t *timers = (timing_manager_t *)malloc(sizeof(timing_manager_t));
+    timing_task_t *tasks = (timing_task_t *)calloc(size, sizeof(timing_task_t));
+    size_t *order = (size_t *)malloc(size * sizeof(size_t));
+    unsigned seed = 3;
+    for(size_t i = 0; i < size; ++i)
+    {
+        order[i] = i;
+    }
+    for(size_t i = size - 1; i > 0; --i)
+    {
+        size_t j = rand_r(&seed) % (i + 1), swap = order[i];
+        order[i] = order[j];
+        order[j] = swap;
+    }
+    timing_manager_init(timers, NULL);
+
+    size_t num_samples = 0;
+    double start = bench_now_ns();
+    for(size_t i = 0; i < size; i += BENCH_SAMPLE_OPS)
+    {
+        size_t ops = size - i < BENCH_SAMPLE_OPS ? size - i : BENCH_SAMPLE_OPS;
+        double sample_start = bench_now_ns();
+        for(size_t k = 0; k < ops; ++k)
+        {
+            timing_manager_add(timers, &tasks[i + k], 60000 + rand_r(&seed) % 3600000, bench_timer_fired, NULL);
+        }
+        samples[num_samples++] = (bench_now_ns() - sample_start) / ops;
+    }
+    bench_report("timing_manager_add", bench_now_ns() - start, size, samples, num_samples);
+
+    num_samples = 0;
+    start = bench_now_ns();
+    for(size_t i = 0; i < size; i += BENCH_SAMPLE_OPS)
+    {
+        size_t ops = size - i < BENCH_SAMPLE_OPS ? size - i : BENCH_SAMPLE_OPS;
+        double sample_start = bench_now_ns();
+        for(size_t k = 0; k < ops; ++k)
+        {
+            timing_manager_cancel(timers, &tasks[order[i + k]]);
+        }
+        samples[num_samples++] = (bench_now_ns() - sample_start) / ops;
+    }
+    bench_report("timing_manager_cancel", bench_now_ns() - start, size, samples, num_samples);
+
+    timing_manager_close(timers);
+    free(order);
+    free(tasks);
+    free(timers);
+}
+
+int main(int argc, char **argv)
+{
+    size_t size = argc > 1 ? (size_t)atol(argv[1]) : BENCH_SIZE;
+    int num_threads = argc > 2 ? atoi(argv[2]) : BENCH_THREADS;
+    int pool_threads = argc > 3 ? atoi(argv[3]) : NUM_HANDLER_THREADS;
+    if(size < 1 || size > 8000000 || num_threads < 1 || num_threads > BENCH_MAX_THREADS
+        || pool_threads < 1 || pool_threads > BENCH_MAX_THREADS)
+    {
+        fprintf(stderr, "usage: %s [size, 1 to 8000000] [submitting threads, 1 to %d] [pool threads, 1 to %d]\n",
+            argv[0], BENCH_MAX_THREADS, BENCH_MAX_THREADS);
+        return EXIT_FAILURE;
+    }
+
+    /* At least one sample per emergency task of the thread pool benchmark: */
+    double *samples = (double *)malloc((size > BENCH_EMERGENCY_TASKS ? size : BENCH_EMERGENCY_TASKS) * sizeof(double));
+    if(samples == NULL)
+    {
+        return EXIT_FAILURE;
+    }
+
+    printf("size %zu, %d submitting threads, %d pool threads\n", size, num_threads, pool_threads);
+    bench_htab(size, samples);
+    bench_skiplist(size, samples);
+    bench_runs(size, samples, false);
+    bench_runs(size, samples, true);
+    bench_llist(size, samples);
+    bench_spsc_ring(size, samples);
+    bench_thread_pool(size, num_threads, pool_threads, samples);
+    bench_timing_manager(size, samples);
+
+    free(samples);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,155 @@
+#include <math.h>
+#include <string.h>
+#include "bloom.h"
+
+#define BLOOM_MAX_HASHES 16
+
+static uint64_t bloom_hash(uint64_t id)
+{
+    /* splitmix64 finaliser, independent of the plate table's hash: */
+    id += 0x9e3779b97f4a7c15ULL;
+    id = (id ^ (id >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    id = (id ^ (id >> 27)) * 0x94d049bb133111ebULL;
+    return id ^ (id >> 31);
+}
+
+/**
+ * @brief Expected false positive rate of a blocked filter. Keys are spread
+ * over blocks unevenly (Poisson), and the fuller blocks dominate the rate.
+ */
+static double bloom_blocked_rate(double bits_per_key, unsigned num_hashes)
+{
+    double keys_per_block = BLOOM_BLOCK_BITS / bits_per_key;
+    double p_keys = exp(-keys_per_block);
+    double rate = 0;
+
+    for(unsigned keys = 0; keys < keys_per_block * 4 + 32; ++keys)
+    {
+        rate += p_keys * pow(1 - exp(-(double)num_hashes * keys / BLOOM_BLOCK_BITS), num_hashes);
+        p_keys *= keys_per_block / (keys + 1);
+    }
+
+    return rate;
+}
+
+bool bloom_init(bloom_t *self, size_t n, double false_positive_rate)
+{
+    memset(self, 0, sizeof(bloom_t));
+    if(false_positive_rate <= 0 || false_positive_rate >= 1)
+    {
+        return false;
+    }
+
+    /* Start from the optimal classic filter, m/n = -ln(p) / ln(2)^2, k = m/n * ln(2),
+       then grow until the blocked filter meets the rate too: */
+    double bits_per_key = -log(false_positive_rate) / (M_LN2 * M_LN2);
+    do
+    {
+        self->num_hashes = (unsigned)round(bits_per_key * M_LN2);
+        if(self->num_hashes < 1)
+        {
+            self->num_hashes = 1;
+        }
+        if(self->num_hashes > BLOOM_MAX_HASHES)
+        {
+            self->num_hashes = BLOOM_MAX_HASHES;
+        }
+        bits_per_key *= 1.05;
+    } while(bloom_blocked_rate(bits_per_key / 1.05, self->num_hashes) > false_positive_rate);
+    bits_per_key /= 1.05;
+
+    self->num_blocks = (size_t)ceil(bits_per_key * (n + 1) / BLOOM_BLOCK_BITS);
+
+    if(posix_memalign((void **)&self->blocks, sizeof(bloom_block_t), self->num_blocks * sizeof(bloom_block_t)) != 0)
+    {
+        self->blocks = NULL;
+        return false;
+    }
+    memset(self->blocks, 0, self->num_blocks * sizeof(bloom_block_t));
+
+    return true;
+}
+
+/**
+ * @brief Pick the block of a key, and seed the stream its bit indices are drawn from.
+ */
+static bloom_block_t *bloom_block(const bloom_t *self, uint64_t id, uint64_t *bits)
+{
+    uint64_t h = bloom_hash(id);
+    *bits = bloom_hash(h);
+
+    /* Map the top 32 bits onto [0, num_blocks) without a division: */
+    return &self->blocks[((h >> 32) * self->num_blocks) >> 32];
+}
+
+/**
+ * @brief Draw the next bit index in a block, 9 bits at a time from the stream.
+ */
+static uint32_t bloom_next_bit(uint64_t *bits, unsigned i)
+{
+    if(i > 0 && i % 7 == 0)
+    { /* 63 bits used up, refill: */
+        *bits = bloom_hash(*bits);
+    }
+
+    uint32_t bit = *bits % BLOOM_BLOCK_BITS;
+    *bits /= BLOOM_BLOCK_BITS;
+    return bit;
+}
+
+void bloom_add(bloom_t *self, uint64_t id)
+{
+    uint64_t bits;
+    bloom_block_t *block = bloom_block(self, id, &bits);
+
+    for(unsigned i = 0; i < self->num_hashes; ++i)
+    {
+        uint32_t bit = bloom_next_bit(&bits, i);
+        block->words[bit / 64] |= 1ULL << (bit % 64);
+    }
+}
+
+bool bloom_check(const bloom_t *self, uint64_t id)
+{
+    if(self->blocks == NULL)
+    { /* No filter, everything may be in the set. */
+        return true;
+    }
+
+    uint64_t bits;
+    const bloom_block_t *block = bloom_block(self, id, &bits);
+
+    for(unsigned i = 0; i < self->num_hashes; ++i)
+    {
+        uint32_t bit = bloom_next_bit(&bits, i);
+        if(!((block->words[bit / 64] >> (bit % 64)) & 1))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void bloom_record(bloom_t *self, bool passed, bool found)
+{
+    if(!passed)
+    {
+        atomic_fetch_add_explicit(&self->stats.misses, 1, memory_order_relaxed);
+    }
+    else if(found)
+    {
+        atomic_fetch_add_explicit(&self->stats.hits, 1, memory_order_relaxed);
+    }
+    else
+    {
+        atomic_fetch_add_explicit(&self->stats.false_positives, 1, memory_order_relaxed);
+    }
+}
+
+void bloom_destroy(bloom_t *self)
+{
+    free(self->blocks);
+    self->blocks = NULL;
+    self->num_blocks = 0;
+}
@@ -0,0 +1,62 @@
+#ifndef  BLOOM_H
+#define  BLOOM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdatomic.h>
+
+/* Bits in one block, one cache line: */
+#define BLOOM_BLOCK_BITS 512
+
+typedef struct bloom_block_t
+{
+    uint64_t words[BLOOM_BLOCK_BITS / 64];
+} bloom_block_t;
+
+/* Counts of checks against the filter, to help size it: */
+typedef struct bloom_stats_t
+{
+    _Atomic uint64_t hits;              /* passed and was in the set */
+    _Atomic uint64_t misses;            /* rejected by the filter alone */
+    _Atomic uint64_t false_positives;   /* passed but was not in the set */
+} bloom_stats_t;
+
+/**
+ * @brief A blocked Bloom filter over packed keys (see `htab_key()`).
+ * All bits for a key are in one 64 byte block, so a check reads a single
+ * cache line. Answers "definitely not in the set" or "maybe in the set".
+ */
+typedef struct bloom_t
+{
+    bloom_block_t *blocks;
+    size_t num_blocks;
+    unsigned num_hashes;
+    bloom_stats_t stats;
+} bloom_t;
+
+/**
+ * @brief Size a filter for n keys with the given false positive rate (e.g. 0.01).
+ */
+bool bloom_init(bloom_t *self, size_t n, double false_positive_rate);
+
+void bloom_add(bloom_t *self, uint64_t id);
+
+/**
+ * @brief Check a key against the filter.
+ *
+ * @returns False if the key is definitely not in the set.
+ */
+bool bloom_check(const bloom_t *self, uint64_t id);
+
+/**
+ * @brief Record the outcome of a check, once the set itself has been asked.
+ *
+ * @param passed Result of `bloom_check()`.
+ * @param found Whether the key was really in the set.
+ */
+void bloom_record(bloom_t *self, bool passed, bool found);
+
+void bloom_destroy(bloom_t *self);
+
+#endif //BLOOM_H
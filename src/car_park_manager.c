@@ -1,9 +1,13 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h> 
+#include <errno.h>
 #include <time.h>
 #include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
 #include <sys/mman.h>
+#include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/time.h>
 #include <unistd.h>
@@ -14,15 +18,40 @@
 #include "shared_memory.h"
 #include "linked_list.h"
 #include "htab.h"
+#include "epoch.h"
+#include "chtab.h"
+#include "plate_index.h"
 #include "thread_pool.h"
+#include "thread_affinity.h"
 #include "manage_hardware.h"
 
 #define FPS 1
 
 // Create variable
-char auth_lplates[TOTAL_CAPACITY][LICENSE_PLATE_LENGTH + 1];
-int vehicle_tracker[TOTAL_CAPACITY];
-double start_time[TOTAL_CAPACITY];
+    // Authorised License Plates, swapped for a new index on reload
+_Atomic(plate_index_t *) auth_index;
+epoch_t auth_index_epoch;
+
+    // Day pass plates, added and removed while the gates keep reading them
+#define DAY_PASS_FILE "daypasses.txt"
+chtab_t day_passes;
+    // Day passes no longer listed, kept until their car leaves. Same values as in day_passes
+chtab_t revoked_passes;
+
+    // Value for the next new plate or day pass. Only the reload thread
+    // touches it once started, published indexes are never written to
+int plate_next_value;
+
+    // Session of each license plate value, kept in fixed size chunks so a
+    // reload can add plates without moving the sessions of parked cars
+#define SESSION_CHUNK_SIZE 65536
+#define SESSION_MAX_CHUNKS 1024
+typedef struct vehicle_session_t
+{
+    int floor;          // level the vehicle was last seen entering, 0 if none
+    double start_time;  // time the vehicle entered, 0 if not in the car park
+} vehicle_session_t;
+vehicle_session_t *vehicle_sessions[SESSION_MAX_CHUNKS];
 
 // Display 
 double revenue = 0;
@@ -36,8 +65,6 @@ char level_lps_current[NUM_LEVELS][LICENSE_PLATE_LENGTH + 1];
 shared_mem_t shared_mem;
 shared_mem_t handshake_mem;
 
-htab_t vehicle_table;
-
 bool quit;
 sem_t quit_sem;
 
@@ -61,11 +88,222 @@ void *wait_sim_close(void *args)
 
 //////////////////// End quit functionality.
 
+//////////////////// Session functionality:
+
+// Function for getting the session of a license plate value
+vehicle_session_t *session(int license_value) {
+    return &vehicle_sessions[license_value / SESSION_CHUNK_SIZE][license_value % SESSION_CHUNK_SIZE];
+}
+
+// Function for allocating sessions for every value below next_value
+bool sessions_reserve(int next_value) {
+    for (int c = 0; c * SESSION_CHUNK_SIZE < next_value; c++) {
+        if (c >= SESSION_MAX_CHUNKS) {
+            return false;
+        }
+        if (vehicle_sessions[c] == NULL) {
+            vehicle_sessions[c] = (vehicle_session_t *)calloc(SESSION_CHUNK_SIZE, sizeof(vehicle_session_t));
+            if (vehicle_sessions[c] == NULL) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// Function for checking if a license plate value has a car in the park
+bool session_parked(int license_value) {
+    return session(license_value)->start_time != 0;
+}
+
+//////////////////// End session functionality.
+
+//////////////////// Plate reload functionality:
+
+// Function for looking up the value of an authorised license plate
+    // Returns -1 if the plate is not authorised, or is only kept until its
+    // car leaves and the car is entering. Never blocks on a reload,
+    // reader is the calling thread's ID from epoch_register()
+int lp_value(int reader, char license[LICENSE_PLATE_LENGTH + 1], bool entering){
+
+    epoch_enter(&auth_index_epoch, reader);
+    plate_index_t *index = atomic_load(&auth_index);
+    int license_value = plate_index_find(index, license);
+    if (license_value >= 0 && entering && plate_index_exit_only(index, license)) {
+        // Revoked while parked, may only leave
+        license_value = -1;
+    }
+    else if (license_value < 0) {
+        // Not a permit holder, may have a day pass
+        license_value = chtab_find(&day_passes, license);
+        if (license_value >= 0 && entering && chtab_find(&revoked_passes, license) >= 0) {
+            license_value = -1;
+        }
+    }
+    epoch_exit(&auth_index_epoch, reader);
+
+    return license_value;
+}
+
+// Function for checking if a plate is only authorised until its car leaves
+bool lp_exit_only(int reader, char license[LICENSE_PLATE_LENGTH + 1]){
+
+    epoch_enter(&auth_index_epoch, reader);
+    bool exit_only = plate_index_exit_only(atomic_load(&auth_index), license)
+        || chtab_find(&revoked_passes, license) >= 0;
+    epoch_exit(&auth_index_epoch, reader);
+
+    return exit_only;
+}
+
+// Function for the value of a plate's day pass, -1 if it has none
+    // Called on the reload thread, the only one changing the day passes
+int day_pass_value(const char *plate) {
+    return chtab_find(&day_passes, plate);
+}
+
+// Function for rebuilding the plate index from the plate file and swapping it in
+    // Plates keep their values, so sessions of parked cars carry over. That
+    // includes a day pass car whose plate is given a permit while parked
+void plate_index_reload(void) {
+
+    plate_index_t *current = atomic_load(&auth_index);
+    plate_index_t *next = plate_index_load(AUTH_PLATES_FILE, current, plate_next_value, day_pass_value, session_parked);
+    if (next == NULL || !sessions_reserve(next->next_value)) {
+        fprintf(stderr, "unable to reload %s, keeping current plates\n", AUTH_PLATES_FILE);
+        if (next != NULL) {
+            plate_index_free(next);
+        }
+        return;
+    }
+
+    // Publish, then wait for lookups still using the old index
+    plate_next_value = next->next_value;
+    atomic_store(&auth_index, next);
+    epoch_synchronize(&auth_index_epoch);
+    plate_index_free(current);
+}
+
+// Function for syncing the day passes with the day pass file
+    // Runs on the reload thread, the only one changing the plate index or the
+    // day passes. New passes take values from plate_next_value, so they
+    // never share a session with a permit holder
+void day_passes_reload(void) {
+
+    // A missing file lists no passes, so deleting it revokes them
+    plate_arena_t plates;
+    htab_t listed;
+    bool missing = access(DAY_PASS_FILE, F_OK) != 0 && errno == ENOENT;
+    if (!plate_arena_init(&plates, day_passes.count)
+        || (!missing && !plate_load_file(DAY_PASS_FILE, &plates, 1))
+        || !plate_arena_build_htab(&plates, &listed)) {
+        fprintf(stderr, "unable to reload %s, keeping current day passes\n", DAY_PASS_FILE);
+        plate_arena_destroy(&plates);
+        return;
+    }
+
+    // Remove passes no longer listed, unless the car is still parked, in
+    // which case it may only leave. Its exit raises SIGHUP to come back here
+    size_t cursor = 0;
+    char plate[HTAB_KEY_LENGTH + 1];
+    int value;
+    while (chtab_next(&day_passes, &cursor, plate, &value)) {
+        if (htab_find(&listed, plate) != NULL) {
+            continue;
+        }
+        if (!session_parked(value)) {
+            chtab_delete(&day_passes, plate);
+            chtab_delete(&revoked_passes, plate);
+        }
+        else if (chtab_find(&revoked_passes, plate) < 0 && !chtab_add(&revoked_passes, plate, value)) {
+            fprintf(stderr, "unable to revoke day pass %s\n", plate);
+        }
+    }
+
+    // Add new passes, skipping plates that already have a permit
+    plate_index_t *index = atomic_load(&auth_index);
+    for (size_t i = 0; i < plates.count; i++) {
+        char *new_plate = plate_arena_get(&plates, i);
+        if (chtab_find(&day_passes, new_plate) >= 0) {
+            // Listed again, so no longer revoked
+            chtab_delete(&revoked_passes, new_plate);
+            continue;
+        }
+        if (htab_find(&index->table, new_plate) != NULL) {
+            continue;
+        }
+        if (!sessions_reserve(plate_next_value + 1)
+            || !chtab_add(&day_passes, new_plate, plate_next_value)) {
+            fprintf(stderr, "unable to add day pass %s\n", new_plate);
+            break;
+        }
+        plate_next_value++;
+    }
+
+    htab_destroy(&listed);
+    plate_arena_destroy(&plates);
+}
+
+// Function for checking if a file changed since last, updating last if it did
+    // A missing file reads as all zeroes, so deleting it is a change too
+bool file_changed(const char *path, struct stat *last) {
+
+    struct stat now;
+    if (stat(path, &now) != 0) {
+        memset(&now, 0, sizeof(now));
+    }
+    if ((now.st_mtim.tv_sec == last->st_mtim.tv_sec
+        && now.st_mtim.tv_nsec == last->st_mtim.tv_nsec && now.st_size == last->st_size)) {
+        return false;
+    }
+
+    *last = now;
+    return true;
+}
+
+/**
+ * @brief Use this in a thread dedicated to reloading the authorised plates
+ * and day passes. Reloads when the plate or day pass file changes (checked
+ * every second) or on SIGHUP, which must be blocked in every thread. The exit
+ * monitors raise SIGHUP when an exit-only car leaves, so its plate is dropped.
+ *
+ * @returns NULL.
+ */
+void *plate_reload_loop(void *args)
+{
+    sigset_t reload_signals;
+    sigemptyset(&reload_signals);
+    sigaddset(&reload_signals, SIGHUP);
+    struct timespec poll_interval = { 1, 0 };
+
+    struct stat last, day_pass_last;
+    stat(AUTH_PLATES_FILE, &last);
+    memset(&day_pass_last, 0, sizeof(day_pass_last)); /* Load any day passes on the first poll. */
+
+    while(!quit)
+    {
+        bool reload = sigtimedwait(&reload_signals, NULL, &poll_interval) == SIGHUP;
+
+        if(file_changed(AUTH_PLATES_FILE, &last) || reload)
+        {
+            plate_index_reload();
+        }
+        if(file_changed(DAY_PASS_FILE, &day_pass_last) || reload)
+        {
+            day_passes_reload();
+        }
+    }
+
+    return NULL;
+}
+
+//////////////////// End plate reload functionality.
+
 // Function for Scanning For license Plate
-int lp_scan(char license[LICENSE_PLATE_LENGTH + 1]){
+int lp_scan(int reader, char license[LICENSE_PLATE_LENGTH + 1]){
 
         // Check if characters match
-        if(htab_find(&vehicle_table, license))
+        if(lp_value(reader, license, true) >= 0)
         {
             // printf("Match Found \n");
             return 1;
@@ -115,6 +353,11 @@ void *entrance_monitor(void *args) {
     free(args);
 
     shared_data_t *shm_data = (shared_data_t *)shared_mem.data;
+    int reader = epoch_register(&auth_index_epoch);
+    if (reader < 0) {
+        fprintf(stderr, "entrance %d: no epoch reader left, not monitoring it\n", gate);
+        return NULL;
+    }
     
     char license[LICENSE_PLATE_LENGTH + 1];
     int floor_signal;
@@ -131,15 +374,13 @@ void *entrance_monitor(void *args) {
         if (vehicle_counter_total < FLOOR_CAPACITY*NUM_LEVELS) {
 
         // Check if license plate is on list
-            item_t *auth_car = htab_find(&vehicle_table, license);
-            if(auth_car == NULL)
+            int license_value = lp_value(reader, license, true);
+            if(license_value < 0)
             { /* No match, not authorised. */
                 info_sign_update(&shm_data->entrances[gate].info_sign, 'X');
                 continue;
             }
 
-            int license_value = auth_car->value;
-
         // Scan for Empty Floor
             for (int i = 0; i < NUM_LEVELS; i++){
 
@@ -156,7 +397,7 @@ void *entrance_monitor(void *args) {
             // Calculate Time in MS
             gettimeofday(&time, NULL);
             double current_time_ms = time.tv_sec * 1000 + time.tv_usec / 10000;
-            start_time[license_value] = current_time_ms;
+            session(license_value)->start_time = current_time_ms;
 
         // Update Counter
             vehicle_counter_total++;
@@ -180,6 +421,11 @@ void *exit_monitor(void *args) {
     free(args);
 
     shared_data_t *shm_data = (shared_data_t *)shared_mem.data;
+    int reader = epoch_register(&auth_index_epoch);
+    if (reader < 0) {
+        fprintf(stderr, "exit %d: no epoch reader left, not monitoring it\n", ex_id);
+        return NULL;
+    }
 
     char license[LICENSE_PLATE_LENGTH + 1];
     double bill = 0;
@@ -191,21 +437,26 @@ void *exit_monitor(void *args) {
         lplate_sensor_read(&shm_data->exits[ex_id].lplate_sensor, license);
         strcpy(exit_lps_current[ex_id],license);
         // Get Value of License Plate
-        item_t *find_res = htab_find(&vehicle_table, license);
-        if(find_res == NULL)
+        int license_value = lp_value(reader, license, false);
+        if(license_value < 0)
         {
             continue;
         }
-        int license_value = find_res->value;
 
         // Calculate Bill
-        bill = calculate_bill(start_time[license_value]);
+        bill = calculate_bill(session(license_value)->start_time);
+        session(license_value)->start_time = 0;
 
         // Add to revenue 
         revenue = revenue + bill;
 
         // Write to Bill.txt
         write_bill(license, bill);
+
+        // Drop a revoked plate now its car has left, rather than at the next reload
+        if (lp_exit_only(reader, license)) {
+            kill(getpid(), SIGHUP);
+        }
         
         // Open Gate
         boom_gate_admit_one(&shm_data->exits[ex_id].bgate);
@@ -226,6 +477,11 @@ void *lp_monitor( void *args) {
     free(args);
 
     shared_data_t *shm_data = (shared_data_t *)shared_mem.data;
+    int reader = epoch_register(&auth_index_epoch);
+    if (reader < 0) {
+        fprintf(stderr, "level %d: no epoch reader left, not monitoring it\n", floor);
+        return NULL;
+    }
 
     char license[LICENSE_PLATE_LENGTH + 1];
     license[LICENSE_PLATE_LENGTH] = '\0';
@@ -235,25 +491,24 @@ void *lp_monitor( void *args) {
     do {
 
         // Update License
-        lplate_sensor_read(&shm_data->levels[floor].lplate_sensor,license);
+        lplate_sensor_read(&shm_data->levels[floor].lplate_sensor, license);
         strcpy(level_lps_current[floor],license);
         // Get Value of License Plate
-        item_t *find_res = htab_find(&vehicle_table, license);
-        if(find_res == NULL)
+        int license_value = lp_value(reader, license, false);
+        if(license_value < 0)
         {
             continue;
         }
-        int license_value = find_res->value;
 
         // Check if vehicle is entering
-        if (vehicle_tracker[license_value] == 0) {
+        if (session(license_value)->floor == 0) {
             vehicle_counter_floor[floor]++;
-            vehicle_tracker[license_value] = floor;
+            session(license_value)->floor = floor;
         }
         // If not entering, must be leaving
         else {
             vehicle_counter_floor[floor]--;
-            vehicle_tracker[license_value] = 0;
+            session(license_value)->floor = 0;
         }
 
     } while(!quit);
@@ -267,14 +522,32 @@ int main(void)
     quit = false;
 
     // Initialise
-            // create a hash table with 100 buckets
-    size_t num_buckets = 100;
-    if(!htab_init(&vehicle_table, num_buckets))
+        // Block SIGHUP in every thread, the reload thread waits for it
+    sigset_t reload_signals;
+    sigemptyset(&reload_signals);
+    sigaddset(&reload_signals, SIGHUP);
+    pthread_sigmask(SIG_BLOCK, &reload_signals, NULL);
+
+        // Keep thread groups to their CPUs, and name them for profiles
+    if(!thread_affinity_load(THREAD_AFFINITY_FILE))
+    {
+        return -1;
+    }
+    thread_affinity_pin(THREAD_GROUP_MANAGER, pthread_self());
+
+        // Create License Plate index
+    epoch_init(&auth_index_epoch);
+    plate_index_t *first_index = plate_index_load(AUTH_PLATES_FILE, NULL, 1, NULL, NULL);
+    if(first_index == NULL || !sessions_reserve(first_index->next_value))
+    {
+        return -1;
+    }
+    plate_next_value = first_index->next_value;
+    atomic_init(&auth_index, first_index);
+    if(!chtab_init(&day_passes, 64, &auth_index_epoch) || !chtab_init(&revoked_passes, 16, &auth_index_epoch))
     {
         return -1;
     }
-        // Create License Plate Array
-    lp_list(&vehicle_table, auth_lplates);
 
         /* Setup shared memory and attach: */
     shared_mem_data_init(&shared_mem, SHM_SIZE, SHM_NAME, SHM_NAME_LENGTH);
@@ -304,6 +577,12 @@ int main(void)
     /* Create thread for monitoring running state of sim: */
     pthread_t quit_thread;
     pthread_create(&quit_thread, NULL, wait_sim_close, NULL);
+    thread_affinity_apply(THREAD_GROUP_MANAGER, quit_thread, "sim-watch", -1);
+
+    /* Create thread for reloading the authorised plates: */
+    pthread_t reload_thread;
+    pthread_create(&reload_thread, NULL, plate_reload_loop, NULL);
+    thread_affinity_apply(THREAD_GROUP_MANAGER, reload_thread, "plate-reload", -1);
 
     // Create Thread for Entrance
     uint8_t *ids;
@@ -312,6 +591,7 @@ int main(void)
         ids = (uint8_t *)malloc(sizeof(uint8_t));
         *ids = i;
         pthread_create(&entrance_monitor_thread[i], NULL, entrance_monitor, (void *)ids);
+        thread_affinity_apply(THREAD_GROUP_ENTRANCE_MONITORS, entrance_monitor_thread[i], "entry-mon", i);
     }
 
     // Create Thread for Exit
@@ -320,6 +600,7 @@ int main(void)
         ids = (uint8_t *)malloc(sizeof(uint8_t));
         *ids = i;
         pthread_create(&exit_monitor_thread[i], NULL, exit_monitor, (void *)ids);
+        thread_affinity_apply(THREAD_GROUP_EXIT_MONITORS, exit_monitor_thread[i], "exit-mon", i);
     }
 
     // Create thread for LP sensor
@@ -328,17 +609,33 @@ int main(void)
         ids = (uint8_t *)malloc(sizeof(uint8_t));
         *ids = i;
         pthread_create(&lp_monitor_thread[i], NULL, lp_monitor, (void *)ids);
+        thread_affinity_apply(THREAD_GROUP_LEVEL_MONITORS, lp_monitor_thread[i], "level-mon", i);
     }
     ids = NULL;
 
     // Displaying Information
 
     setvbuf(stdout, NULL, _IOFBF, 2000);
+#ifdef PLATE_BLOOM
+    int display_reader = epoch_register(&auth_index_epoch);
+    if (display_reader < 0) {
+        fprintf(stderr, "no epoch reader left for the display\n");
+        return -1;
+    }
+#endif
     do {
 
         system("clear");
         // Signs Display
         printf("Car Park\nCapacity: %d/%d\nRevenue: $%d\n", vehicle_counter_total, NUM_LEVELS*FLOOR_CAPACITY, revenue);
+#ifdef PLATE_BLOOM
+        // Plate filter counts, for sizing it (reset on reload)
+        epoch_enter(&auth_index_epoch, display_reader);
+        bloom_stats_t *bloom_stats = &atomic_load(&auth_index)->bloom.stats;
+        printf("Plate Filter: %" PRIu64 " hits, %" PRIu64 " rejected, %" PRIu64 " false positives\n",
+            atomic_load(&bloom_stats->hits), atomic_load(&bloom_stats->misses), atomic_load(&bloom_stats->false_positives));
+        epoch_exit(&auth_index_epoch, display_reader);
+#endif
 
         for (int i = 0; i < NUM_LEVELS; i++){
             printf("Level: %d \t| License Plate Reader: %s\t| Capacity: %d/%d\n", i + 1, level_lps_current[i], vehicle_counter_floor[i], FLOOR_CAPACITY);
@@ -362,6 +659,7 @@ int main(void)
     /* Shutdown sequence: */
         /* Join threads: */
     pthread_join(quit_thread, NULL);
+    pthread_join(reload_thread, NULL);
         /* Entrances: */
     for (int i = 0; i < NUM_ENTRANCES; i++){
         pthread_join(entrance_monitor_thread[i], NULL);
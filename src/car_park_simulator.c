@@ -1,4 +1,5 @@
 #include <stdint.h>
+#include <inttypes.h>
 #include <stdbool.h>
 #include <string.h>
 #include <pthread.h>
@@ -7,10 +8,27 @@
 #include <semaphore.h>
 #include "utils.h"
 #include "shared_memory.h"
+#include "lplate_sensor.h"
 #include "linked_list.h"
+#include "slab.h"
+#include "skiplist.h"
+#include "spsc_ring.h"
 #include "thread_pool.h"
-
-#define NUM_BUCKETS 100
+#include "timing_manager.h"
+#include "thread_affinity.h"
+
+    // Car threads, overridden from the command line. Cars only borrow one
+    // to leave, parked cars wait on timers, so a few serve any number of cars
+#define CAR_THREADS_MIN NUM_HANDLER_THREADS
+#define CAR_THREADS_MAX (4 * NUM_HANDLER_THREADS)
+    // Cars to simulate, overridden from the command line
+#define CARS_TO_SIM 20
+    // Cars the car slab has room for up front: a full car park plus a few queued at each entrance
+#define CAR_SLAB_SLOTS (TOTAL_CAPACITY + 4 * NUM_ENTRANCES)
+    // Cars that can queue at each entrance before the car generator waits
+#define ENTRANCE_QUEUE_SIZE 256
+    // Authorised plates drawn for a new car before giving up on finding one not in use
+#define UNIQUE_PLATE_TRIES 32
 
 bool quit;
 sem_t quit_sem;
@@ -18,9 +36,10 @@ shared_mem_t shared_mem;
 shared_mem_t handshake_mem;
 thread_pool_t car_thread_pool;
 htab_t auth_vehicle_plates_htab;
-char auth_lplates[TOTAL_CAPACITY][LICENSE_PLATE_LENGTH + 1];
+plate_arena_t auth_lplates;
 pthread_mutex_t random_gen_mutex;
 unsigned int time_scale = 1;
+size_t cars_to_simulate = CARS_TO_SIM;
 
 //////////////////// Shared memory functionality:
 
@@ -166,8 +185,7 @@ int shm_data_init(pthread_mutexattr_t *mutex_attr, pthread_condattr_t *cond_attr
         pthread_cond_init(&shm_data->entrances[i].info_sign.info_sign_update_flag, cond_attr);
         
             /* License plate sensor: */
-        pthread_mutex_init(&shm_data->entrances[i].lplate_sensor.lplate_sensor_mutex, mutex_attr);
-        pthread_cond_init(&shm_data->entrances[i].lplate_sensor.lplate_sensor_update_flag, cond_attr);
+        lplate_sensor_init(&shm_data->entrances[i].lplate_sensor);
     }
         /* Exits: */
     for(uint8_t i = 0; i < NUM_EXITS; ++i)
@@ -177,15 +195,13 @@ int shm_data_init(pthread_mutexattr_t *mutex_attr, pthread_condattr_t *cond_attr
         pthread_cond_init(&shm_data->exits[i].bgate.bgate_update_flag, cond_attr);
         
             /* License plate sensor: */
-        pthread_mutex_init(&shm_data->exits[i].lplate_sensor.lplate_sensor_mutex, mutex_attr);
-        pthread_cond_init(&shm_data->exits[i].lplate_sensor.lplate_sensor_update_flag, cond_attr);
+        lplate_sensor_init(&shm_data->exits[i].lplate_sensor);
     }
         /* Levels: */
     for(uint8_t i = 0; i < NUM_LEVELS; ++i)
     {   
             /* License plate sensor: */
-        pthread_mutex_init(&shm_data->levels[i].lplate_sensor.lplate_sensor_mutex, mutex_attr);
-        pthread_cond_init(&shm_data->levels[i].lplate_sensor.lplate_sensor_update_flag, cond_attr);
+        lplate_sensor_init(&shm_data->levels[i].lplate_sensor);
     }
 
     /* Signal to the manager that the shared memory is ready: */
@@ -221,9 +237,6 @@ void shm_data_close(pthread_mutexattr_t *mutex_attr, pthread_condattr_t *cond_at
         pthread_mutex_destroy(&shm_data->entrances[i].info_sign.info_sign_mutex);
         pthread_cond_destroy(&shm_data->entrances[i].info_sign.info_sign_update_flag);
         
-            /* License plate sensor: */
-        pthread_mutex_destroy(&shm_data->entrances[i].lplate_sensor.lplate_sensor_mutex);
-        pthread_cond_destroy(&shm_data->entrances[i].lplate_sensor.lplate_sensor_update_flag);
     }
             /* Exits: */
     for(uint8_t i = 0; i < NUM_EXITS; ++i)
@@ -232,16 +245,10 @@ void shm_data_close(pthread_mutexattr_t *mutex_attr, pthread_condattr_t *cond_at
         pthread_mutex_destroy(&shm_data->exits[i].bgate.bgate_mutex);
         pthread_cond_destroy(&shm_data->exits[i].bgate.bgate_update_flag);
         
-            /* License plate sensor: */
-        pthread_mutex_destroy(&shm_data->exits[i].lplate_sensor.lplate_sensor_mutex);
-        pthread_cond_destroy(&shm_data->exits[i].lplate_sensor.lplate_sensor_update_flag);
     }
             /* Levels: */
     for(uint8_t i = 0; i < NUM_LEVELS; ++i)
     {   
-            /* License plate sensor: */
-        pthread_mutex_destroy(&shm_data->levels[i].lplate_sensor.lplate_sensor_mutex);
-        pthread_cond_destroy(&shm_data->levels[i].lplate_sensor.lplate_sensor_update_flag);
     }
 
     /* Destroy shared memory: */
@@ -249,6 +256,7 @@ void shm_data_close(pthread_mutexattr_t *mutex_attr, pthread_condattr_t *cond_at
     destroy_shared_object(&handshake_mem);
 
     htab_destroy(&auth_vehicle_plates_htab);
+    plate_arena_destroy(&auth_lplates);
 
     random_close(&random_gen_mutex);
     sem_destroy(&quit_sem);
@@ -332,36 +340,50 @@ void boom_gate_wait_open(boom_gate_t *bgate)
 
 //////////////////// End boom gate functionality.
 
-//////////////////// License plate sensor functionality:
+//////////////////// Car functionality and model:
 
-void lplate_sensor_trigger(license_plate_sensor_t *lps, char* lplate)
+/**
+ * @brief Where a car is in its life. A car never holds a thread: it sits in
+ * one of these states until the event it waits on arrives, then car_step()
+ * acts on the event and moves it to the next.
+ */
+typedef enum car_state_t
 {
-    pthread_mutex_lock(&lps->lplate_sensor_mutex);
-    strcpy(lps->license_plate, lplate);
-    pthread_mutex_unlock(&lps->lplate_sensor_mutex);
-    pthread_cond_signal(&lps->lplate_sensor_update_flag);
-}
-
-//////////////////// End license plate sensor functionality.
-
-//////////////////// Car functionality and model:
+    CAR_QUEUED,         // in an entrance queue, waiting to drive up
+    CAR_AT_SIGN,        // LPS triggered, waiting for the sign
+    CAR_AT_GATE,        // allowed in, waiting for the boom gate to open
+    CAR_PARKED,         // waiting for its dwell timer
+    CAR_DONE            // left, or was turned away, and freed
+} car_state_t;
+
+typedef enum car_event_t
+{
+    CAR_EVENT_ARRIVED,      // reached the front of its entrance queue
+    CAR_EVENT_SIGN,         // the entrance sign displayed something
+    CAR_EVENT_GATE_OPEN,    // the entrance boom gate opened
+    CAR_EVENT_TIMER         // its dwell timer expired
+} car_event_t;
 
 typedef struct car_t
 {
     char license_plate[LICENSE_PLATE_LENGTH];
     uint8_t level_assigned;
-    // pthread_t sim_thread;
+    car_state_t state;
+    struct entrance_queue_t *e_queue;   // entrance it queued at
+    timing_task_t timer;
 } car_t;
 
-list_t *car_list;
-pthread_mutex_t car_list_mutex;
+arena_t run_arena;      // cars and car_index's nodes, released together at the end of the run
+skiplist_t car_index;   // every car by plate, added and looked up by the car generator
+epoch_t car_index_epoch;
+int car_gen_reader;     // car generator's reader of car_index_epoch
+slab_t car_slab; // every car, queued or in the car park
+timing_manager_t car_timers;
 
+/* The car generator is the only producer of each queue, its entrance's thread the only consumer: */
 typedef struct entrance_queues_sh_data_t
 {
-    list_t *queue[NUM_ENTRANCES];
-    sem_t full[NUM_ENTRANCES];
-    sem_t cars_simulating;
-    pthread_mutex_t mutex[NUM_ENTRANCES];
+    spsc_ring_t queue[NUM_ENTRANCES];
 } entrance_queues_sh_data_t;
 
 typedef struct entrance_queue_t
@@ -370,63 +392,29 @@ typedef struct entrance_queue_t
     uint8_t entrance_num;
 } entrance_queue_t;
 
-typedef struct car_info_t
-{
-    node_t *car_node;
-    entrance_queue_t *e_queue;
-    pthread_cond_t *entrance_leave;
-    pthread_mutex_t *occupy_mutex;
-} car_management_info_t;
+car_state_t car_step(car_t *car, car_event_t event, char display);
 
-void *car_simulation_loop(void *args);
-
-void entrance_queue_init(entrance_queues_sh_data_t *e_q_sh_data)
+bool entrance_queue_init(entrance_queues_sh_data_t *e_q_sh_data)
 {
-    /* Initialise the linked lists: */
+    /* Initialise the ring queues: */
+    bool ok = true;
     for(uint8_t e = 0; e < NUM_ENTRANCES; ++e)
     {
-        llist_init(&e_q_sh_data->queue[e], NULL, NULL);
-    }
-
-    /* Initialise the semaphores: */
-    for(uint8_t e = 0; e < NUM_ENTRANCES; ++e)
-    {
-        sem_init(&e_q_sh_data->full[e], 0, SEM_LOCAL);
-    }
-    sem_init(&e_q_sh_data->cars_simulating, 0, SEM_LOCAL);
-
-    /* Initialise the mutexes: */
-    for(uint8_t e = 0; e < NUM_ENTRANCES; ++e)
-    {
-        pthread_mutex_init(&e_q_sh_data->mutex[e], NULL);
+        ok = spsc_ring_init(&e_q_sh_data->queue[e], ENTRANCE_QUEUE_SIZE) && ok;
     }
+    return ok;
 }
 
 void entrance_queue_close(entrance_queues_sh_data_t *e_q_sh_data)
 {
-    for(uint8_t e = 0; e < NUM_ENTRANCES; ++e)
-    {
-        llist_close(e_q_sh_data->queue[e]);
-    }
-
-    for(uint8_t e = 0; e < NUM_ENTRANCES; ++e)
-    {
-        sem_destroy(&e_q_sh_data->full[e]);
-    }
-    sem_destroy(&e_q_sh_data->cars_simulating);
+    /* Cars still queued are freed with run_arena. */
 
     for(uint8_t e = 0; e < NUM_ENTRANCES; ++e)
     {
-        pthread_mutex_destroy(&e_q_sh_data->mutex[e]);
+        spsc_ring_destroy(&e_q_sh_data->queue[e]);
     }
 }
 
-void car_leave_entrance(car_management_info_t *car_man_info, uint8_t entrance_num)
-{
-    pthread_mutex_unlock(car_man_info->occupy_mutex);
-    pthread_cond_signal(car_man_info->entrance_leave);
-}
-
 /**
  * @brief A function intended to monitor a single entrance to ensure one car is processed at a time.
  * Must be run in its own thread.
@@ -434,62 +422,48 @@ void car_leave_entrance(car_management_info_t *car_man_info, uint8_t entrance_nu
  * Note that is is implemented using the Bounded Buffer design pattern where each entrance acts
  * as a single slot buffer. As it is a single slot buffer the 'empty' semaphore is binary, which
  * is the same as a mutex.
+ *
+ * The entrance's sign and boom gate can only be waited on by blocking, so this thread waits on
+ * them for the car at the front and hands each event to car_step(). Once the car is past the gate
+ * it waits on a timer instead, and this thread moves on to the next car.
  */
 void *manage_entrances_loop(void *args)
 {
+    shared_data_t *shm_data = (shared_data_t *)shared_mem.data;
     entrance_queue_t *e_queue = (entrance_queue_t *)args;
     entrance_queues_sh_data_t *e_queues_data = e_queue->sh_data;
     uint8_t e_id = e_queue->entrance_num;
 
-    /* Variables needed to ensure one car processed at a time: */
-    pthread_mutex_t occupy_mutex;
-    pthread_cond_t finished;
-    pthread_mutex_init(&occupy_mutex, NULL);
-    pthread_cond_init(&finished, NULL);
-
     do
     {
-        /* Wait until at least one car is at the entrance: */
-        sem_wait(&e_queues_data->full[e_id]);
-        if(quit)
-        { /* Main thread pretending a car has arrived to wake us up: */
+        /* Wait until at least one car is at the entrance, and allow it in: */
+        car_t *car = (car_t *)spsc_ring_pop(&e_queues_data->queue[e_id]);
+        if(car == NULL)
+        { /* Main thread closed the queue to wake us up: */
             break;
         }
-        pthread_mutex_lock(&occupy_mutex);
 
-        pthread_mutex_lock(&e_queues_data->mutex[e_id]);
+        car->e_queue = e_queue;
+        car->state = CAR_QUEUED;
 
-        /* Allow next car in: */
-            /* Remove car from queue: */
-        node_t *old_next_car_node = llist_pop(e_queues_data->queue[e_id]);
-        pthread_mutex_unlock(&e_queues_data->mutex[e_id]);
+        /* Wait a bit before triggering the LPS: */
+        delay_ms(2, time_scale);
+        car_state_t state = car_step(car, CAR_EVENT_ARRIVED, 0);
 
-            /* Put into linked list of existing cars: */
-        pthread_mutex_lock(&car_list_mutex);
-        node_t *next_car_node = llist_push(car_list, old_next_car_node->data, sizeof(car_t));
-        pthread_mutex_unlock(&car_list_mutex);
-
-        /* Note `llist_push()` will shallow copy the node data, so free the old copy: */
-        llist_delete_dangling_node(old_next_car_node, NULL);
-        
-        
-        /* Spin off a thread for it: */
-        car_management_info_t *car_man_info = (car_management_info_t *)malloc(sizeof(car_management_info_t));
-        car_man_info->car_node = next_car_node;
-        car_man_info->e_queue = e_queue;
-        car_man_info->entrance_leave = &finished;
-        car_man_info->occupy_mutex = &occupy_mutex;
-        thread_pool_add_request(&car_thread_pool, car_simulation_loop, car_man_info);
-
-        /* Wait for the car thread that was just started to leave the entrance.
-           Car thread will hold the mutex until it has left the entrance. */
-        pthread_cond_wait(&finished, &occupy_mutex);
-        pthread_mutex_unlock(&occupy_mutex);
+        /* Feed the car the events it waits on until it leaves the entrance: */
+        if(state == CAR_AT_SIGN)
+        {
+            char display;
+            info_sign_read(&shm_data->entrances[e_id].info_sign, &display);
+            state = car_step(car, CAR_EVENT_SIGN, display);
+        }
+        if(state == CAR_AT_GATE)
+        {
+            boom_gate_wait_open(&shm_data->entrances[e_id].bgate);
+            car_step(car, CAR_EVENT_GATE_OPEN, 0);
+        }
     } while(!quit);
 
-    pthread_mutex_destroy(&occupy_mutex);
-    pthread_cond_destroy(&finished);
-
     return NULL;
 }
 
@@ -508,18 +482,22 @@ void generate_license_plate(char *lplate)
     }
 }
 
+/**
+ * @brief Check if a car with the given plate is queued or in the car park,
+ * from the car generator, without holding up the threads changing car_index.
+ */
+bool car_in_park(const char *lplate)
+{
+    epoch_enter(&car_index_epoch, car_gen_reader);
+    bool found = skiplist_find(&car_index, skiplist_key(lplate, LICENSE_PLATE_LENGTH)) != NULL;
+    epoch_exit(&car_index_epoch, car_gen_reader);
+    return found;
+}
+
 void generate_unique_license_plate(char *lplate)
 {
-    /* Ensure car doesn't currently exist (no license plate duplicates): */
-    // if(random_int(&random_gen_mutex, 0, 1) == 0)
-    if(false)
-    {
-        do
-        {
-            generate_license_plate(lplate);
-        } while (llist_find(car_list, lplate) != NULL);
-    }
-    else
+    /* Ensure car doesn't currently exist (no license plate duplicates), with an authorised plate if one is free: */
+    for(int tries = 0; tries < UNIQUE_PLATE_TRIES; ++tries)
     {
         item_t *auth_car;
         do
@@ -527,8 +505,19 @@ void generate_unique_license_plate(char *lplate)
             generate_license_plate(lplate);
             auth_car = htab_bucket(&auth_vehicle_plates_htab, lplate);
         } while (auth_car == NULL);
-        strcpy(lplate, auth_car->key);
+
+        if(!car_in_park(auth_car->key))
+        {
+            memcpy(lplate, auth_car->key, LICENSE_PLATE_LENGTH);
+            return;
+        }
     }
+
+    /* Authorised plates all seem to be in use, make one up: */
+    do
+    {
+        generate_license_plate(lplate);
+    } while (car_in_park(lplate));
 }
 
 /**
@@ -536,34 +525,15 @@ void generate_unique_license_plate(char *lplate)
  */
 void generate_and_queue_car(entrance_queues_sh_data_t *e_queue_sh_data, uint8_t entrance_num)
 {
-    /* Create node in linked list for a new car: (This will allocate memory for new car) */
-    node_t *car_node = llist_append_empty(e_queue_sh_data->queue[entrance_num], sizeof(car_t));
-    car_t *new_car = (car_t *)car_node->data;
+    /* Allocate the new car: */
+    car_t *new_car = (car_t *)slab_alloc(&car_slab);
     
-    /* Generate license plate: */
+    /* Generate license plate, and index the car so the next one can't share it: */
     generate_unique_license_plate(new_car->license_plate);
-}
-
-int car_compare_lplate(const void *lplate1, const void *car)
-{
-    car_t *_car = (car_t *)car;
-    char *lplate2 = (char *)_car->license_plate;
-    /* When a car is generated, its node will have a license plate of null term chars so ignore it: */
-    if(lplate2[0] != 0)
-    {
-        // if(strcmp(_lplate1, _lplate2) == 0)
-        if(memcmp(lplate1, lplate2, LICENSE_PLATE_LENGTH) == 0)
-        { /* Exact match. */
-            return 0;
-        }
-    // else if()
-    // { /* Before alphabetically and numerically: */
-    //     /* TODO: Implement functionality to compare license plates in ascending order! */
-    // }
-    }
+    skiplist_insert(&car_index, skiplist_key(new_car->license_plate, LICENSE_PLATE_LENGTH), new_car);
 
-    /* Once compare function complete, delete below return statement! */
-    return -1;
+    /* Queue it, waiting for room if the entrance's queue is full: */
+    spsc_ring_push(&e_queue_sh_data->queue[entrance_num], new_car);
 }
 
 // void car_data_destroy(void *car_data)
@@ -574,130 +544,169 @@ int car_compare_lplate(const void *lplate1, const void *car)
 //     pthread_join(car->sim_thread, NULL);
 // }
 
-size_t cars_sim_ended;
-pthread_mutex_t cars_sim_ended_mutex;
-pthread_cond_t cars_sim_ended_cond;
-void *car_simulation_loop(void *args)
+thread_pool_group_t cars_simulating;
+/**
+ * @brief Remove a car from the simulation and tell the car generator.
+ * The car's memory is freed.
+ */
+void car_finish(car_t *car)
 {
-    shared_data_t *shm_data = (shared_data_t *)shared_mem.data;
-
-    car_management_info_t *car_man_info = (car_management_info_t *)args;
-    car_t *car_data = (car_t *)car_man_info->car_node->data;
-    entrance_queues_sh_data_t *e_queues_data = car_man_info->e_queue->sh_data;
-    uint8_t en_id = car_man_info->e_queue->entrance_num;
+    skiplist_delete(&car_index, skiplist_key(car->license_plate, LICENSE_PLATE_LENGTH), car);
+    slab_free(&car_slab, car);
 
-    /* Lock the entrance occupied mutex: */
-    pthread_mutex_lock(car_man_info->occupy_mutex);
-
-    /* Wait a bit before triggering the LPS: */
-    delay_ms(2, time_scale);
-    lplate_sensor_trigger(&shm_data->entrances[en_id].lplate_sensor, car_data->license_plate);
+    /* Signal to car generator that car has finished simulating: */
+    thread_pool_group_done(&cars_simulating);
+}
 
-    /* Get information from digital sign: */
-    char display;
-    info_sign_read(&shm_data->entrances[en_id].info_sign, &display);
+/**
+ * @brief Timer function of a parked car, run on the car thread pool.
+ */
+void *car_timer_expired(void *args)
+{
+    car_step((car_t *)args, CAR_EVENT_TIMER, 0);
+    return NULL;
+}
 
-    /* Respond to information received from sign (if digit given continue, else rejected): */
-    if('0' <= display && display <= '9')
-    { /* Car allowed. */
-    /* Deviant behaviour (30% chance): */
-        uint8_t level = atoi(&display);
+/**
+ * @brief Advance a car on an event it was waiting for. Does what the car does
+ * next, without blocking, and leaves it in the state for the next event it waits on.
+ *
+ * @param display What the sign displayed, for CAR_EVENT_SIGN.
+ * @returns The car's new state. Read the car no more once it is CAR_DONE (it
+ * is freed) or CAR_PARKED (its timer may already be running it).
+ */
+car_state_t car_step(car_t *car, car_event_t event, char display)
+{
+    shared_data_t *shm_data = (shared_data_t *)shared_mem.data;
+    uint8_t en_id = car->e_queue->entrance_num;
+    car_state_t state = car->state;
 
-    /* Wait for boom gate to open: */
-        boom_gate_wait_open(&shm_data->entrances[en_id].bgate);
+    switch(state)
+    {
+        case CAR_QUEUED:
+            if(event == CAR_EVENT_ARRIVED)
+            {
+                lplate_sensor_trigger(&shm_data->entrances[en_id].lplate_sensor, car->license_plate);
+                state = CAR_AT_SIGN;
+            }
+            break;
 
-    /* Car finished with the LPS and ready to enter, unlock occupy mutex.
-       Also, signal that entrance is available to the next car: */
-        car_leave_entrance(car_man_info, en_id);
+        case CAR_AT_SIGN:
+            if(event != CAR_EVENT_SIGN)
+            {
+                break;
+            }
+            /* Respond to information received from sign (if digit given continue, else rejected): */
+            if('0' <= display && display <= '9')
+            { /* Car allowed. */
+                car->level_assigned = display - '0';
+                state = CAR_AT_GATE;
+            }
+            else
+            { /* Car rejected. */
+                car_finish(car);
+                return CAR_DONE;
+            }
+            break;
 
-    /* Continue into the car park: */
-        /* Go to assigned level and trigger level LPS: */
-        lplate_sensor_trigger(&shm_data->levels[level].lplate_sensor, car_data->license_plate);
+        case CAR_AT_GATE:
+            if(event == CAR_EVENT_GATE_OPEN)
+            {
+                /* Go to assigned level and trigger level LPS: */
+                lplate_sensor_trigger(&shm_data->levels[car->level_assigned].lplate_sensor, car->license_plate);
+
+                /* Stay in car park for a random period of time (between 100-10,000 ms): */
+                car->state = CAR_PARKED;
+                unsigned int dwell_ms = random_int(&random_gen_mutex, 100, 10000) * time_scale;
+                timing_manager_add(&car_timers, &car->timer, dwell_ms, car_timer_expired, car);
+                return CAR_PARKED;
+            }
+            break;
 
-    /* Stay in car park for a random period of time (between 100-10,000 ms): */
-        delay_random_ms(&random_gen_mutex, 100, 10000, time_scale);
+        case CAR_PARKED:
+            if(event == CAR_EVENT_TIMER)
+            {
+                /* Leave after finish parking, triggering level LPS and exit LPS: */
+                lplate_sensor_trigger(&shm_data->levels[car->level_assigned].lplate_sensor, car->license_plate);
+                uint8_t ex_id = random_int(&random_gen_mutex, 0, NUM_EXITS - 1);
+                lplate_sensor_trigger(&shm_data->exits[ex_id].lplate_sensor, car->license_plate);
+                car_finish(car);
+                return CAR_DONE;
+            }
+            break;
 
-    /* Leave after finish parking, triggering level LPS and exit LPS: */
-        uint8_t ex_id = random_int(&random_gen_mutex, 0, NUM_EXITS - 1);
-        lplate_sensor_trigger(&shm_data->exits[ex_id].lplate_sensor, car_data->license_plate);
-    }
-    else
-    { /* Car rejected. */
-        car_leave_entrance(car_man_info, en_id);
+        case CAR_DONE:
+            break;
     }
 
-    /* Remove car from simulation: */
-    pthread_mutex_lock(&car_list_mutex);
-    llist_delete_node(car_list, car_man_info->car_node);
-    pthread_mutex_unlock(&car_list_mutex);
-
-    /* Signal to car generator that car has finished simulating: */
-    pthread_mutex_lock(&cars_sim_ended_mutex);
-    ++cars_sim_ended;
-    sem_post(&e_queues_data->cars_simulating);
-    pthread_mutex_unlock(&cars_sim_ended_mutex);
-
-    /* Free memory for car info, but not its contents: */
-    free(car_man_info);
-
-    return NULL;
+    car->state = state;
+    return state;
 }
 
 void *generate_cars_loop(void *args)
 {
     entrance_queues_sh_data_t *e_q_sh_data = (entrance_queues_sh_data_t *)args;
 
-    // TODO: have ability to limit number of cars in the simulation from cmd line:
-    size_t cars_to_sim = 20;
-    size_t cars_sim_started = 0;
-    cars_sim_ended = 0;
-    
-    do
+    size_t cars_to_sim = cars_to_simulate;
+    for(size_t cars_sim_started = 0; cars_sim_started < cars_to_sim && !quit; ++cars_sim_started)
     {
         /* Chose a random entrance to queue at: */
         uint8_t entrance_num = random_int(&random_gen_mutex, 0, NUM_ENTRANCES - 1);
-        pthread_mutex_lock(&e_q_sh_data->mutex[entrance_num]);
+        thread_pool_group_add(&cars_simulating, 1);
         generate_and_queue_car(e_q_sh_data, entrance_num);
-        ++cars_sim_started;
-        pthread_mutex_unlock(&e_q_sh_data->mutex[entrance_num]);
-        sem_post(&e_q_sh_data->full[entrance_num]);
 
         /* Sleep for random time: */
         delay_random_ms(&random_gen_mutex, 1, 100, time_scale);
+    }
 
-        if(cars_sim_started >= cars_to_sim)
-        { /* Stop generating new cars */
-            /* Wait for all cars to finish simulating: */
-            while(true)
-            {
-                pthread_mutex_lock(&cars_sim_ended_mutex);
-                if(cars_sim_ended >= cars_to_sim - 1)
-                {
-                    quit = true;
-                    sem_post(&quit_sem);
-                    pthread_mutex_unlock(&cars_sim_ended_mutex);
-                    break;
-                }
-                pthread_mutex_unlock(&cars_sim_ended_mutex);
-                sem_wait(&e_q_sh_data->cars_simulating);
-            }
-        }
-    } while(!quit);
+    /* Stop generating new cars, and wait for all cars to finish simulating: */
+    thread_pool_group_wait(&cars_simulating);
+    quit = true;
+    sem_post(&quit_sem);
 
     return NULL;
 }
 
+/**
+ * @brief Pin and name each car thread as it is spawned.
+ */
+void car_thread_setup(pthread_t thread, size_t index)
+{
+    thread_affinity_apply(THREAD_GROUP_POOL_WORKERS, thread, "car-pool", (int)index);
+}
+
+/**
+ * @brief Report how busy the car thread pool was, if built with METRICS=1,
+ * to tell a simulator bottleneck from a manager one.
+ */
+void print_car_pool_metrics(void)
+{
+    thread_pool_metrics_t metrics;
+    if(!thread_pool_metrics(&car_thread_pool, &metrics))
+    {
+        return;
+    }
+
+    printf("Car threads: %" PRIu64 " requests, %.1f%% busy\n", metrics.requests, metrics.utilisation * 100);
+    printf("  queue wait (ns): p50 %" PRIu64 ", p99 %" PRIu64 ", max %" PRIu64 "\n",
+        metrics.wait.p50, metrics.wait.p99, metrics.wait.max);
+    printf("  run time (ns):   p50 %" PRIu64 ", p99 %" PRIu64 ", max %" PRIu64 "\n",
+        metrics.run.p50, metrics.run.p99, metrics.run.max);
+}
+
 //////////////////// End car functionality and model.
 
-int main(void)
+int main(int argc, char **argv)
 {
     quit = false;
     sem_init(&quit_sem, 0, SEM_LOCAL);
 
     random_init(&random_gen_mutex, time(0));
 
-    htab_init(&auth_vehicle_plates_htab, NUM_BUCKETS);
-    lp_list(&auth_vehicle_plates_htab, auth_lplates);
+    if(!lp_list(&auth_vehicle_plates_htab, &auth_lplates))
+    {
+        return -1;
+    }
 
     /* Initialise shared memory: */
     pthread_mutexattr_t mutex_attr;
@@ -716,9 +725,22 @@ int main(void)
 
     /* Initialise threading: */
         /* Initialise variables needed for threads: */
-    llist_init(&car_list, car_compare_lplate, NULL);
+    arena_init(&run_arena);
+    if(!slab_init_arena(&car_slab, &run_arena, sizeof(car_t), CAR_SLAB_SLOTS))
+    {
+        return -1;
+    }
+    epoch_init(&car_index_epoch);
+    car_gen_reader = epoch_register(&car_index_epoch);
+    if(car_gen_reader < 0 || !skiplist_init_arena(&car_index, &car_index_epoch, &run_arena))
+    {
+        return -1;
+    }
     entrance_queues_sh_data_t entrance_queues_sh_data;
-    entrance_queue_init(&entrance_queues_sh_data);
+    if(!entrance_queue_init(&entrance_queues_sh_data))
+    {
+        return -1;
+    }
     entrance_queue_t entrance_queues[NUM_ENTRANCES];
     for(uint8_t e = 0; e < NUM_ENTRANCES; ++e)
     {
@@ -726,19 +748,38 @@ int main(void)
         entrance_queues[e].entrance_num = e;
     }
 
-        /* Setup thread pool for cars: */
-    thread_pool_init(&car_thread_pool);
+        /* Keep thread groups to their CPUs, and name them for profiles: */
+    if(!thread_affinity_load(THREAD_AFFINITY_FILE))
+    {
+        return -1;
+    }
+    thread_affinity_pin(THREAD_GROUP_SIMULATOR, pthread_self());
+
+        /* Setup thread pool for cars, and the timers parked cars wait on: */
+    size_t car_threads_min = argc > 1 ? (size_t)atol(argv[1]) : CAR_THREADS_MIN;
+    size_t car_threads_max = argc > 2 ? (size_t)atol(argv[2]) : CAR_THREADS_MAX;
+    cars_to_simulate = argc > 3 ? (size_t)atol(argv[3]) : CARS_TO_SIM;
+    if(cars_to_simulate == 0 || !thread_pool_init_sized(&car_thread_pool, car_threads_min, car_threads_max))
+    {
+        fprintf(stderr, "usage: %s [min car threads] [max car threads, at least 1] [cars, at least 1]\n", argv[0]);
+        return -1;
+    }
+    timing_manager_init(&car_timers, &car_thread_pool);
+    thread_affinity_apply(THREAD_GROUP_SIMULATOR, car_timers.thread, "car-timer", -1);
+    thread_pool_set_thread_setup(&car_thread_pool, car_thread_setup);
 
         /* Setup car generator thread: */
+    thread_pool_group_init(&cars_simulating);
     pthread_t car_gen_thread;
     pthread_create(&car_gen_thread, NULL, generate_cars_loop, (void *)&entrance_queues_sh_data);
+    thread_affinity_apply(THREAD_GROUP_SIMULATOR, car_gen_thread, "car-gen", -1);
 
         /* Setup car entrance queue manager thread: */
     pthread_t manage_entrances_threads[NUM_ENTRANCES];
-    pthread_mutex_init(&car_list_mutex, NULL);
     for(uint8_t e = 0; e < NUM_ENTRANCES; ++e)
     {
         pthread_create(&manage_entrances_threads[e], NULL, manage_entrances_loop, (void *)&entrance_queues[e]);
+        thread_affinity_apply(THREAD_GROUP_ENTRANCE_QUEUES, manage_entrances_threads[e], "entry-queue", e);
     }
 
     /* End of simulation: */
@@ -748,17 +789,22 @@ int main(void)
     sem_post(&handshake_data->simulator_closing);
     sem_wait(&handshake_data->manager_finished);
 
-    /* Close all threads: */
+    /* Close all threads, the timers first as they queue onto the pool: */
+    timing_manager_close(&car_timers);
+    print_car_pool_metrics();
     thread_pool_close(&car_thread_pool);
     for(uint8_t e = 0; e < NUM_ENTRANCES; ++e)
     {
-        /* Ensure no thread is stuck waiting for a car via the `full` semaphore: */
-        sem_post(&entrance_queues_sh_data.full[e]);
+        /* Ensure no thread is stuck waiting for a car on an empty queue: */
+        spsc_ring_close(&entrance_queues_sh_data.queue[e]);
 
         pthread_join(manage_entrances_threads[e], NULL);
     }
     pthread_join(car_gen_thread, NULL);
     entrance_queue_close(&entrance_queues_sh_data);
+    skiplist_destroy(&car_index);
+    slab_destroy(&car_slab);
+    arena_destroy(&run_arena);
 
     shm_data_close(&mutex_attr, &cond_attr);
 }
\ No newline at end of file
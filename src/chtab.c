@@ -0,0 +1,207 @@
+#include <stdlib.h>
+#include <string.h>
+#include "chtab.h"
+
+/* Marks a deleted slot, can't clash with a packed key (see `htab.c`): */
+#define CHTAB_TOMBSTONE UINT64_MAX
+
+/* Copy the slot array once more than 3/4 of it has been used: */
+#define CHTAB_MAX_LOAD_NUM 3
+#define CHTAB_MAX_LOAD_DEN 4
+
+static chtab_array_t *chtab_array_new(size_t n)
+{
+    /* At most half full when new, like `htab_init()`: */
+    size_t size = 2;
+    while(size < n * 2)
+    {
+        size <<= 1;
+    }
+
+    chtab_array_t *array = (chtab_array_t *)calloc(1, sizeof(chtab_array_t) + size * sizeof(chtab_slot_t));
+    if(array != NULL)
+    {
+        array->size = size;
+    }
+
+    return array;
+}
+
+/**
+ * @brief Find the slot holding id, or the empty slot that ends its probe sequence.
+ */
+static chtab_slot_t *chtab_probe(chtab_array_t *array, uint64_t id)
+{
+    size_t mask = array->size - 1;
+    size_t s = htab_hash(id) & mask;
+    uint64_t slot_id;
+
+    /* Acquire pairs with the release in chtab_insert(), so the value is
+       written before the ID is seen: */
+    while((slot_id = atomic_load_explicit(&array->slots[s].id, memory_order_acquire)) != 0 && slot_id != id)
+    {
+        s = (s + 1) & mask;
+    }
+
+    return &array->slots[s];
+}
+
+bool chtab_init(chtab_t *self, size_t n, epoch_t *epoch)
+{
+    chtab_array_t *array = chtab_array_new(n);
+    if(array == NULL)
+    {
+        return false;
+    }
+
+    atomic_init(&self->array, array);
+    pthread_mutex_init(&self->write_lock, NULL);
+    self->epoch = epoch;
+    self->count = 0;
+
+    return true;
+}
+
+int chtab_find(chtab_t *self, const char *key)
+{
+    uint64_t id = htab_key(key);
+    if(id == 0)
+    {
+        return -1;
+    }
+
+    chtab_slot_t *slot = chtab_probe(atomic_load_explicit(&self->array, memory_order_acquire), id);
+    if(atomic_load_explicit(&slot->id, memory_order_acquire) != id)
+    {
+        return -1;
+    }
+
+    return atomic_load_explicit(&slot->value, memory_order_relaxed);
+}
+
+/**
+ * @brief Fill the empty slot for id. Writers only.
+ */
+static void chtab_insert(chtab_array_t *array, uint64_t id, int value)
+{
+    chtab_slot_t *slot = chtab_probe(array, id);
+    atomic_store_explicit(&slot->value, value, memory_order_relaxed);
+    atomic_store_explicit(&slot->id, id, memory_order_release);
+    ++array->used;
+}
+
+/**
+ * @brief Copy the items into a new slot array with room for one more,
+ * publish it, then free the old one once no reader can be in it. Writers only.
+ */
+static bool chtab_rebuild(chtab_t *self)
+{
+    chtab_array_t *old = atomic_load_explicit(&self->array, memory_order_relaxed);
+    chtab_array_t *array = chtab_array_new(self->count + 1);
+    if(array == NULL)
+    {
+        return false;
+    }
+
+    for(size_t s = 0; s < old->size; ++s)
+    {
+        uint64_t id = atomic_load_explicit(&old->slots[s].id, memory_order_relaxed);
+        if(id != 0 && id != CHTAB_TOMBSTONE)
+        {
+            chtab_insert(array, id, atomic_load_explicit(&old->slots[s].value, memory_order_relaxed));
+        }
+    }
+
+    atomic_store_explicit(&self->array, array, memory_order_release);
+    epoch_synchronize(self->epoch);
+    free(old);
+
+    return true;
+}
+
+bool chtab_add(chtab_t *self, const char *key, int value)
+{
+    uint64_t id = htab_key(key);
+    if(id == 0)
+    {
+        return false;
+    }
+
+    pthread_mutex_lock(&self->write_lock);
+
+    bool added = true;
+    chtab_array_t *array = atomic_load_explicit(&self->array, memory_order_relaxed);
+    chtab_slot_t *slot = chtab_probe(array, id);
+    if(atomic_load_explicit(&slot->id, memory_order_relaxed) == id)
+    { /* Already in the table, readers see either value. */
+        atomic_store_explicit(&slot->value, value, memory_order_relaxed);
+    }
+    else
+    {
+        /* Deleted slots are never reused, a reader may still be matching
+           the old key in one. Get a fresh array once they pile up: */
+        if((array->used + 1) * CHTAB_MAX_LOAD_DEN > array->size * CHTAB_MAX_LOAD_NUM)
+        {
+            added = chtab_rebuild(self);
+            array = atomic_load_explicit(&self->array, memory_order_relaxed);
+        }
+        if(added)
+        {
+            chtab_insert(array, id, value);
+            ++self->count;
+        }
+    }
+
+    pthread_mutex_unlock(&self->write_lock);
+    return added;
+}
+
+bool chtab_delete(chtab_t *self, const char *key)
+{
+    uint64_t id = htab_key(key);
+    if(id == 0)
+    {
+        return false;
+    }
+
+    pthread_mutex_lock(&self->write_lock);
+
+    chtab_slot_t *slot = chtab_probe(atomic_load_explicit(&self->array, memory_order_relaxed), id);
+    bool found = atomic_load_explicit(&slot->id, memory_order_relaxed) == id;
+    if(found)
+    { /* The slot stays used, so later keys still probe past it. */
+        atomic_store_explicit(&slot->id, CHTAB_TOMBSTONE, memory_order_release);
+        --self->count;
+    }
+
+    pthread_mutex_unlock(&self->write_lock);
+    return found;
+}
+
+bool chtab_next(chtab_t *self, size_t *cursor, char key[HTAB_KEY_LENGTH + 1], int *value)
+{
+    chtab_array_t *array = atomic_load_explicit(&self->array, memory_order_relaxed);
+    for(; *cursor < array->size; ++*cursor)
+    {
+        chtab_slot_t *slot = &array->slots[*cursor];
+        uint64_t id = atomic_load_explicit(&slot->id, memory_order_relaxed);
+        if(id != 0 && id != CHTAB_TOMBSTONE)
+        {
+            /* Packed keys are NUL padded past HTAB_KEY_LENGTH: */
+            memcpy(key, &id, HTAB_KEY_LENGTH + 1);
+            *value = atomic_load_explicit(&slot->value, memory_order_relaxed);
+            ++*cursor;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void chtab_destroy(chtab_t *self)
+{
+    free(atomic_load(&self->array));
+    atomic_store(&self->array, NULL);
+    pthread_mutex_destroy(&self->write_lock);
+    self->count = 0;
+}
@@ -0,0 +1,85 @@
+#ifndef  CHTAB_H
+#define  CHTAB_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include "htab.h"
+#include "epoch.h"
+
+/**
+ * @brief One slot of a concurrent table. The ID only ever goes from empty
+ * to a key to deleted, so a reader that matched a key reads that key's value.
+ */
+typedef struct chtab_slot_t
+{
+    _Atomic uint64_t id;
+    _Atomic int value;
+} chtab_slot_t;
+
+typedef struct chtab_array_t
+{
+    size_t size;    /* Power of two. */
+    size_t used;    /* Slots ever filled, items and deleted ones. */
+    chtab_slot_t slots[];
+} chtab_array_t;
+
+/**
+ * @brief A hash table mapping plates to values (see `htab_t`) that can be
+ * read by any number of threads while one thread at a time changes it.
+ *
+ * Reads take no locks and never wait: they probe the slot array inside a
+ * read section of the table's epoch. Writers are serialised by a mutex.
+ * Deleting only marks a slot, and once marked slots fill the array it is
+ * copied into a new one, swapped in, and the old one freed after every
+ * reader has left it.
+ */
+typedef struct chtab_t
+{
+    _Atomic(chtab_array_t *) array;
+    pthread_mutex_t write_lock;
+    epoch_t *epoch;
+    size_t count;
+} chtab_t;
+
+/**
+ * @brief Initialise a table sized for n items, whose readers use `epoch`.
+ */
+bool chtab_init(chtab_t *self, size_t n, epoch_t *epoch);
+
+/**
+ * @brief Find the value of a key. Call inside a read section of the table's
+ * epoch, or from a thread that is adding or deleting.
+ *
+ * @returns The value, or -1 if the key is not in the table.
+ */
+int chtab_find(chtab_t *self, const char *key);
+
+/**
+ * @brief Add a key, or replace its value if it is already in the table.
+ * May wait for readers to leave an old slot array.
+ */
+bool chtab_add(chtab_t *self, const char *key, int value);
+
+/**
+ * @brief Delete a key.
+ *
+ * @returns true if the key was in the table.
+ */
+bool chtab_delete(chtab_t *self, const char *key);
+
+/**
+ * @brief Iterate over every item, for the only thread changing the table.
+ * Start with *cursor = 0, deleting the returned item is allowed.
+ *
+ * @returns false once every item has been visited, else true with the item in key and value.
+ */
+bool chtab_next(chtab_t *self, size_t *cursor, char key[HTAB_KEY_LENGTH + 1], int *value);
+
+/**
+ * @brief Destroy a table no thread is reading any more.
+ */
+void chtab_destroy(chtab_t *self);
+
+#endif //CHTAB_H
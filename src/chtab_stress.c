@@ -0,0 +1,206 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include "chtab.h"
+
+/* Stress benchmark for chtab_t: readers look plates up as fast as they can,
+   optionally while a writer keeps adding and deleting day passes.
+   Usage: chtab_stress.out [readers] [seconds per phase] [permits] */
+
+#define STRESS_READERS 16
+#define STRESS_SECONDS 2
+#define STRESS_PERMITS 100000
+    // Day passes the writer adds, then deletes again, each round
+#define STRESS_DAY_PASSES 1000
+
+typedef struct stress_t
+{
+    chtab_t table;
+    epoch_t epoch;
+    size_t permits;
+    _Atomic bool stop;
+    _Atomic uint64_t lookups;
+    _Atomic uint64_t errors;
+    _Atomic uint64_t writes;
+} stress_t;
+
+typedef struct stress_reader_t
+{
+    stress_t *stress;
+    unsigned seed;
+} stress_reader_t;
+
+/**
+ * @brief Write plate i, in the simulator's 3 digits then 3 letters format.
+ */
+static void stress_plate(size_t i, char plate[HTAB_KEY_LENGTH + 1])
+{
+    plate[0] = '0' + i / 100 % 10;
+    plate[1] = '0' + i / 10 % 10;
+    plate[2] = '0' + i % 10;
+    plate[3] = 'A' + i / 1000 % 26;
+    plate[4] = 'A' + i / 26000 % 26;
+    plate[5] = 'A' + i / 676000 % 26;
+    plate[6] = '\0';
+}
+
+static double stress_now(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+/**
+ * @brief Look up random permits, which must always be found with their value,
+ * and random day passes, which may or may not be there but must have their
+ * value if they are. Plate i's value is always i + 1.
+ */
+static void *stress_read_loop(void *args)
+{
+    stress_reader_t *reader_args = (stress_reader_t *)args;
+    stress_t *stress = reader_args->stress;
+    int reader = epoch_register(&stress->epoch);
+    char plate[HTAB_KEY_LENGTH + 1];
+    uint64_t lookups = 0, errors = 0;
+
+    while(!atomic_load_explicit(&stress->stop, memory_order_relaxed))
+    {
+        size_t i = rand_r(&reader_args->seed) % (stress->permits + STRESS_DAY_PASSES);
+        stress_plate(i, plate);
+
+        epoch_enter(&stress->epoch, reader);
+        int value = chtab_find(&stress->table, plate);
+        epoch_exit(&stress->epoch, reader);
+
+        if((i < stress->permits || value != -1) && value != (int)i + 1)
+        {
+            ++errors;
+        }
+        ++lookups;
+    }
+
+    atomic_fetch_add(&stress->lookups, lookups);
+    atomic_fetch_add(&stress->errors, errors);
+    return NULL;
+}
+
+static void *stress_write_loop(void *args)
+{
+    stress_t *stress = (stress_t *)args;
+    char plate[HTAB_KEY_LENGTH + 1];
+    uint64_t writes = 0;
+
+    while(!atomic_load_explicit(&stress->stop, memory_order_relaxed))
+    {
+        for(size_t i = stress->permits; i < stress->permits + STRESS_DAY_PASSES; ++i)
+        {
+            stress_plate(i, plate);
+            chtab_add(&stress->table, plate, (int)i + 1);
+        }
+        for(size_t i = stress->permits; i < stress->permits + STRESS_DAY_PASSES; ++i)
+        {
+            stress_plate(i, plate);
+            chtab_delete(&stress->table, plate);
+        }
+        writes += 2 * STRESS_DAY_PASSES;
+    }
+
+    atomic_fetch_add(&stress->writes, writes);
+    return NULL;
+}
+
+/**
+ * @brief Run the readers (and the writer) for a while and print their throughput.
+ *
+ * @returns false if a reader missed a permit or found a wrong value.
+ */
+static bool stress_phase(stress_t *stress, int num_readers, unsigned seconds, bool writer)
+{
+    pthread_t readers[EPOCH_MAX_READERS];
+    stress_reader_t reader_args[EPOCH_MAX_READERS];
+    pthread_t writer_thread;
+
+    epoch_init(&stress->epoch);
+    atomic_store(&stress->stop, false);
+    atomic_store(&stress->lookups, 0);
+    atomic_store(&stress->errors, 0);
+    atomic_store(&stress->writes, 0);
+
+    double start = stress_now();
+    for(int r = 0; r < num_readers; ++r)
+    {
+        reader_args[r].stress = stress;
+        reader_args[r].seed = r + 1;
+        pthread_create(&readers[r], NULL, stress_read_loop, &reader_args[r]);
+    }
+    if(writer)
+    {
+        pthread_create(&writer_thread, NULL, stress_write_loop, stress);
+    }
+
+    sleep(seconds);
+    atomic_store(&stress->stop, true);
+
+    for(int r = 0; r < num_readers; ++r)
+    {
+        pthread_join(readers[r], NULL);
+    }
+    if(writer)
+    {
+        pthread_join(writer_thread, NULL);
+    }
+    double elapsed = stress_now() - start;
+
+    uint64_t lookups = atomic_load(&stress->lookups);
+    uint64_t errors = atomic_load(&stress->errors);
+    printf("%-14s %2d readers: %8.2f M lookups/s, %6.1f ns/lookup per reader",
+        writer ? "with writer" : "readers only", num_readers,
+        lookups / elapsed / 1e6, elapsed * num_readers * 1e9 / (lookups ? lookups : 1));
+    if(writer)
+    {
+        printf(", %.2f M writes/s", atomic_load(&stress->writes) / elapsed / 1e6);
+    }
+    printf(", %llu errors\n", (unsigned long long)errors);
+
+    return errors == 0;
+}
+
+int main(int argc, char **argv)
+{
+    int num_readers = argc > 1 ? atoi(argv[1]) : STRESS_READERS;
+    unsigned seconds = argc > 2 ? (unsigned)atoi(argv[2]) : STRESS_SECONDS;
+    size_t permits = argc > 3 ? (size_t)atol(argv[3]) : STRESS_PERMITS;
+    if(num_readers < 1 || num_readers > EPOCH_MAX_READERS || permits + STRESS_DAY_PASSES > 17576000)
+    {
+        fprintf(stderr, "usage: %s [readers, 1 to %d] [seconds] [permits]\n", argv[0], EPOCH_MAX_READERS);
+        return EXIT_FAILURE;
+    }
+
+    stress_t *stress = (stress_t *)calloc(1, sizeof(stress_t));
+    if(stress == NULL || !chtab_init(&stress->table, permits, &stress->epoch))
+    {
+        return EXIT_FAILURE;
+    }
+    stress->permits = permits;
+
+    char plate[HTAB_KEY_LENGTH + 1];
+    for(size_t i = 0; i < permits; ++i)
+    {
+        stress_plate(i, plate);
+        chtab_add(&stress->table, plate, (int)i + 1);
+    }
+
+    bool ok = stress_phase(stress, num_readers, seconds, false)
+        && stress_phase(stress, num_readers, seconds, true);
+
+    chtab_destroy(&stress->table);
+    free(stress);
+
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,53 @@
+#include <sched.h>
+#include "epoch.h"
+
+void epoch_init(epoch_t *self)
+{
+    atomic_init(&self->global, 1);
+    atomic_init(&self->num_readers, 0);
+    for(int r = 0; r < EPOCH_MAX_READERS; ++r)
+    {
+        atomic_init(&self->readers[r].epoch, 0);
+    }
+}
+
+int epoch_register(epoch_t *self)
+{
+    int reader = atomic_fetch_add(&self->num_readers, 1);
+    if(reader >= EPOCH_MAX_READERS)
+    {
+        atomic_fetch_sub(&self->num_readers, 1);
+        return -1;
+    }
+
+    return reader;
+}
+
+void epoch_enter(epoch_t *self, int reader)
+{
+    /* Sequentially consistent, so the writer can't miss this store and
+       free data this reader goes on to load: */
+    atomic_store(&self->readers[reader].epoch, atomic_load(&self->global));
+}
+
+void epoch_exit(epoch_t *self, int reader)
+{
+    atomic_store_explicit(&self->readers[reader].epoch, 0, memory_order_release);
+}
+
+void epoch_synchronize(epoch_t *self)
+{
+    /* Readers entering from now on can only see the new pointer: */
+    uint64_t target = atomic_fetch_add(&self->global, 1) + 1;
+
+    int num_readers = atomic_load(&self->num_readers);
+    for(int r = 0; r < num_readers && r < EPOCH_MAX_READERS; ++r)
+    {
+        /* Wait out readers still in a section from an older epoch: */
+        uint64_t epoch;
+        while((epoch = atomic_load(&self->readers[r].epoch)) != 0 && epoch < target)
+        {
+            sched_yield();
+        }
+    }
+}
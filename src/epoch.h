@@ -0,0 +1,55 @@
+#ifndef  EPOCH_H
+#define  EPOCH_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+#define EPOCH_MAX_READERS 64
+#define EPOCH_CACHE_LINE 64
+
+/**
+ * @brief Epoch based reclamation, for data that readers reach through a
+ * pointer which a writer swaps (RCU style). Readers never block: they
+ * publish the epoch they entered in, read through the pointer, then leave.
+ * After swapping the pointer, the writer waits in `epoch_synchronize()`
+ * until every reader that might still hold the old pointer has left,
+ * then frees the old data.
+ */
+typedef struct epoch_reader_t
+{
+    /* 0 when outside a read section, else the epoch it was entered in: */
+    _Atomic uint64_t epoch;
+    char pad[EPOCH_CACHE_LINE - sizeof(uint64_t)];
+} epoch_reader_t;
+
+typedef struct epoch_t
+{
+    _Atomic uint64_t global;
+    _Atomic int num_readers;
+    epoch_reader_t readers[EPOCH_MAX_READERS];
+} epoch_t;
+
+void epoch_init(epoch_t *self);
+
+/**
+ * @brief Register a reader thread, once before its first read section.
+ *
+ * @returns The reader's ID, or -1 if there are already EPOCH_MAX_READERS readers.
+ */
+int epoch_register(epoch_t *self);
+
+/**
+ * @brief Start a read section. Pointers loaded after this stay valid until `epoch_exit()`.
+ */
+void epoch_enter(epoch_t *self, int reader);
+
+void epoch_exit(epoch_t *self, int reader);
+
+/**
+ * @brief Wait until every read section that started before this call has ended.
+ * Call after unpublishing data and before freeing it. Only the writer waits.
+ */
+void epoch_synchronize(epoch_t *self);
+
+#endif //EPOCH_H
@@ -1,11 +1,13 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <time.h>
 #include <pthread.h>
 #include <sys/mman.h>
 #include <sys/types.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include "thread_affinity.h"
 
 int shm_fd;
 volatile void *shm;
@@ -61,7 +63,7 @@ void tempmonitor(int level)
 	for (;;) {
 		// Calculate address of temperature sensor
 		addr = 0150 * level + 2496;
-		temp = *((int16_t *)(shm + addr));
+		temp = *((volatile int16_t *)((volatile char *)shm + addr));
 		
 		// Add temperature to beginning of linked list
 		newtemp = malloc(sizeof(struct tempnode));
@@ -149,10 +151,16 @@ int main()
 	shm_fd = shm_open("PARKING", O_RDWR, 0);
 	shm = (volatile void *) mmap(0, 2920, PROT_READ | PROT_WRITE, MAP_SHARED, shm_fd, 0);
 	
+	if (!thread_affinity_load(THREAD_AFFINITY_FILE)) {
+		return 1;
+	}
+	thread_affinity_pin(THREAD_GROUP_FIRE_ALARM_MONITORS, pthread_self());
+	
 	pthread_t *threads = malloc(sizeof(pthread_t) * LEVELS);
 	
 	for (int i = 0; i < LEVELS; i++) {
-		pthread_create(threads + i, NULL, (void *(*)(void *)) tempmonitor, (void *)i);
+		pthread_create(threads + i, NULL, (void *(*)(void *)) tempmonitor, (void *)(intptr_t)i);
+		thread_affinity_apply(THREAD_GROUP_FIRE_ALARM_MONITORS, threads[i], "fire-mon", i);
 	}
 	for (;;) {
 		if (alarm_active) {
@@ -176,12 +184,12 @@ int main()
 	pthread_t *boomgatethreads = malloc(sizeof(pthread_t) * (ENTRANCES + EXITS));
 	for (int i = 0; i < ENTRANCES; i++) {
 		int addr = 288 * i + 96;
-		volatile struct boomgate *bg = shm + addr;
+		struct boomgate *bg = (struct boomgate *)((char *)shm + addr);
 		pthread_create(boomgatethreads + i, NULL, openboomgate, bg);
 	}
 	for (int i = 0; i < EXITS; i++) {
 		int addr = 192 * i + 1536;
-		volatile struct boomgate *bg = shm + addr;
+		struct boomgate *bg = (struct boomgate *)((char *)shm + addr);
 		pthread_create(boomgatethreads + ENTRANCES + i, NULL, openboomgate, bg);
 	}
 	
@@ -191,7 +199,7 @@ int main()
 		for (char *p = evacmessage; *p != '\0'; p++) {
 			for (int i = 0; i < ENTRANCES; i++) {
 				int addr = 288 * i + 192;
-				volatile struct parkingsign *sign = shm + addr;
+				struct parkingsign *sign = (struct parkingsign *)((char *)shm + addr);
 				pthread_mutex_lock(&sign->m);
 				sign->display = *p;
 				pthread_cond_broadcast(&sign->c);
@@ -0,0 +1,49 @@
+#ifndef  FUTEX_H
+#define  FUTEX_H
+
+#include <stdint.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+/* Thin wrappers of the Linux futex calls, to sleep on a 32 bit word only
+   when a lock-free fast path finds nothing to do. The _shared ones are for
+   words in memory mapped by several processes, the others only for threads
+   of one process. */
+
+/**
+ * @brief Sleep while *word == expected, until woken. May return early for
+ * no reason, so recheck what was waited on.
+ */
+static inline void futex_wait(_Atomic uint32_t *word, uint32_t expected)
+{
+    syscall(SYS_futex, word, FUTEX_WAIT_PRIVATE, expected, NULL, NULL, 0);
+}
+
+/**
+ * @brief Wake up to `count` threads sleeping on word. Only uses the
+ * address, so the word may already be freed.
+ */
+static inline void futex_wake(_Atomic uint32_t *word, int count)
+{
+    syscall(SYS_futex, word, FUTEX_WAKE_PRIVATE, count, NULL, NULL, 0);
+}
+
+/**
+ * @brief As futex_wait(), for a word in shared memory.
+ */
+static inline void futex_wait_shared(_Atomic uint32_t *word, uint32_t expected)
+{
+    syscall(SYS_futex, word, FUTEX_WAIT, expected, NULL, NULL, 0);
+}
+
+/**
+ * @brief As futex_wake(), for a word in shared memory.
+ */
+static inline void futex_wake_shared(_Atomic uint32_t *word, int count)
+{
+    syscall(SYS_futex, word, FUTEX_WAKE, count, NULL, NULL, 0);
+}
+
+#endif //FUTEX_H
@@ -1,14 +1,36 @@
 #include "htab.h"
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+    // Marks an item deleted from the previous slot array while growing.
+    // Byte 7 of a real key is always 0, so it can't clash with one.
+#define HTAB_TOMBSTONE UINT64_MAX
 
 void item_print(item_t *i) {
     printf("key=%s value=%d", i->key, i->value);
 }
 
-    // Initialise a new hash table with n buckets.
+    // Round up to the next power of two (minimum 2).
+static size_t htab_round_pow2(size_t n) {
+    size_t p = 2;
+    while (p < n)
+    {
+        p <<= 1;
+    }
+    return p;
+}
+
+    // Initialise a new hash table sized for n items.
+    // The slot array is kept at most half full so probe sequences stay short.
 bool htab_init(htab_t *h, size_t n) {
-    h->size = n;
-    h->buckets = (item_t **)calloc(n, sizeof(item_t *));
-    return h->buckets != 0;
+    h->size = htab_round_pow2(n * 2);
+    h->count = 0;
+    h->old_slots = NULL;
+    h->old_size = 0;
+    h->migrate_pos = 0;
+    h->slots = (item_t *)calloc(h->size, sizeof(item_t));
+    return h->slots != 0;
 }
 
     // The Bernstein hash function.
@@ -23,113 +45,400 @@ size_t djb_hash(char *s) {
     return hash;
 }
 
-    // Calculate the offset for the bucket for key in hash table.
+    // Pack a key into the integer stored in an item. Only the first
+    // HTAB_KEY_LENGTH chars are used, the rest of the integer is zero.
+uint64_t htab_key(const char *key) {
+    char packed[sizeof(uint64_t)] = {0};
+    for (size_t i = 0; i < HTAB_KEY_LENGTH && key[i] != '\0'; ++i)
+    {
+        packed[i] = key[i];
+    }
+
+    uint64_t id;
+    memcpy(&id, packed, sizeof(id));
+    return id;
+}
+
+    // Mix the bits of a packed key (MurmurHash3 finaliser).
+size_t htab_hash(uint64_t id) {
+    id ^= id >> 33;
+    id *= 0xff51afd7ed558ccdULL;
+    id ^= id >> 33;
+    id *= 0xc4ceb9fe1a85ec53ULL;
+    id ^= id >> 33;
+    return (size_t)id;
+}
+
+#ifdef __AVX2__
+    // Multiply 4 pairs of 64 bit lanes, keeping the low 64 bits like the
+    // scalar multiply. AVX2 only multiplies 32 bit halves, so build it from three.
+static __m256i htab_mul64_avx2(__m256i a, __m256i b) {
+    __m256i low = _mm256_mul_epu32(a, b);
+    __m256i cross = _mm256_add_epi64(_mm256_mul_epu32(_mm256_srli_epi64(a, 32), b),
+        _mm256_mul_epu32(a, _mm256_srli_epi64(b, 32)));
+    return _mm256_add_epi64(low, _mm256_slli_epi64(cross, 32));
+}
+
+    // htab_hash() of 4 packed keys at once.
+static __m256i htab_hash_avx2(__m256i id) {
+    const __m256i m1 = _mm256_set1_epi64x((long long)0xff51afd7ed558ccdULL);
+    const __m256i m2 = _mm256_set1_epi64x((long long)0xc4ceb9fe1a85ec53ULL);
+    id = _mm256_xor_si256(id, _mm256_srli_epi64(id, 33));
+    id = htab_mul64_avx2(id, m1);
+    id = _mm256_xor_si256(id, _mm256_srli_epi64(id, 33));
+    id = htab_mul64_avx2(id, m2);
+    return _mm256_xor_si256(id, _mm256_srli_epi64(id, 33));
+}
+#endif
+
+    // Hash n packed keys, 4 at a time with AVX2, the rest one at a time.
+void htab_hash_batch(const uint64_t *ids, size_t n, size_t *hashes) {
+    size_t k = 0;
+#ifdef __AVX2__
+    for (; k + 4 <= n; k += 4)
+    {
+        __m256i id = _mm256_loadu_si256((const __m256i *)&ids[k]);
+        _mm256_storeu_si256((__m256i *)&hashes[k], htab_hash_avx2(id));
+    }
+#endif
+    for (; k < n; ++k)
+    {
+        hashes[k] = htab_hash(ids[k]);
+    }
+}
+
+    // Calculate the offset for the home slot for key in hash table.
 size_t htab_index(htab_t *h, char *key) {
-    return djb_hash(key) % h->size;
+    return htab_hash(htab_key(key)) & (h->size - 1);
 }
 
-    // Find pointer to head of list for key in hash table.
+    // Check if a slot holds an item, rather than nothing or a tombstone.
+static bool htab_live(item_t *i) {
+    return i->id != 0 && i->id != HTAB_TOMBSTONE;
+}
+
+    // Find the item in the home slot for key, or NULL if that slot is empty.
 item_t *htab_bucket(htab_t *h, char *key) {
-    return h->buckets[htab_index(h, key)];
+    item_t *i = &h->slots[htab_index(h, key)];
+    if (!htab_live(i) && h->old_slots != NULL)
+    {
+        i = &h->old_slots[htab_hash(htab_key(key)) & (h->old_size - 1)];
+    }
+    return htab_live(i) ? i : NULL;
+}
+
+    // Find the slot holding id in a slot array, or the empty slot that ends
+    // its probe sequence. Tombstones don't end a probe sequence.
+static size_t htab_probe(item_t *slots, size_t size, uint64_t id) {
+    size_t mask = size - 1;
+    size_t s = htab_hash(id) & mask;
+    while (slots[s].id != 0 && slots[s].id != id)
+    {
+        s = (s + 1) & mask;
+    }
+    return s;
+}
+
+    // Find an item for id in the previous slot array, if growing.
+static item_t *htab_find_old(htab_t *h, uint64_t id) {
+    if (h->old_slots == NULL)
+    {
+        return NULL;
+    }
+
+    item_t *i = &h->old_slots[htab_probe(h->old_slots, h->old_size, id)];
+    return i->id != 0 ? i : NULL;
 }
 
     // Find an item for key in hash table.
 item_t *htab_find(htab_t *h, char *key) {
-    for (item_t *i = htab_bucket(h, key); i != NULL; i = i->next)
+    uint64_t id = htab_key(key);
+    if (id == 0)
     {
-        if (strcmp(i->key, key) == 0)
-        { // found the key
-            return i;
+        return NULL;
+    }
+
+    // moved items are found in the new array first
+    item_t *i = &h->slots[htab_probe(h->slots, h->size, id)];
+    return i->id != 0 ? i : htab_find_old(h, id);
+}
+
+    // Probe for id from its home slot in a slot array, returning its value or -1.
+static int htab_probe_value(const item_t *slots, size_t size, size_t hash, uint64_t id) {
+    size_t mask = size - 1;
+    for (size_t s = hash & mask; slots[s].id != 0; s = (s + 1) & mask)
+    {
+        if (slots[s].id == id)
+        {
+            return slots[s].value;
         }
     }
-    return NULL;
+    return -1;
 }
 
-    // Add a key with value to the hash table.
-bool htab_add(htab_t *h, char *key, int value) {
-    // allocate new item
-    item_t *newhead = (item_t *)malloc(sizeof(item_t));
-    if (newhead == NULL)
+    // Find the values of n packed keys, HTAB_BATCH at a time.
+size_t htab_find_batch(const htab_t *h, const uint64_t *ids, size_t n, int *values) {
+    size_t hashes[HTAB_BATCH];
+    size_t found = 0;
+    size_t mask = h->size - 1;
+
+    for (size_t b = 0; b < n; b += HTAB_BATCH)
     {
-        return false;
+        size_t batch = n - b < HTAB_BATCH ? n - b : HTAB_BATCH;
+        htab_hash_batch(&ids[b], batch, hashes);
+
+        // start every home slot load before waiting on the first
+        for (size_t k = 0; k < batch; ++k)
+        {
+            __builtin_prefetch(&h->slots[hashes[k] & mask]);
+        }
+
+        for (size_t k = 0; k < batch; ++k)
+        {
+            uint64_t id = ids[b + k];
+            int value = -1;
+            if (id != 0)
+            {
+                value = htab_probe_value(h->slots, h->size, hashes[k], id);
+                if (value < 0 && h->old_slots != NULL)
+                {
+                    // tombstones never match, so a deleted item is not found
+                    value = htab_probe_value(h->old_slots, h->old_size, hashes[k], id);
+                }
+            }
+
+            values[b + k] = value;
+            found += value >= 0;
+        }
     }
 
-    newhead->key = key;
-    newhead->value = value;
+    return found;
+}
+
+    // Insert an item that is known not to be in the current slot array.
+static void htab_insert(htab_t *h, uint64_t id, int value) {
+    item_t *i = &h->slots[htab_probe(h->slots, h->size, id)];
+    i->id = id;
+    i->value = value;
+}
+
+    // Move up to n slots of the previous slot array over, freeing it when done.
+    // Moved items stay behind in the previous array, but are found in the new
+    // one first; deleting an item tombstones it in both.
+static void htab_migrate(htab_t *h, size_t n) {
+    for (; n > 0 && h->old_slots != NULL; --n)
+    {
+        item_t *i = &h->old_slots[h->migrate_pos];
+        if (htab_live(i))
+        {
+            htab_insert(h, i->id, i->value);
+        }
+
+        if (++h->migrate_pos == h->old_size)
+        {
+            free(h->old_slots);
+            h->old_slots = NULL;
+            h->old_size = 0;
+            h->migrate_pos = 0;
+        }
+    }
+}
+
+    // Start growing into a slot array twice the size. Any previous growth
+    // is finished first.
+static bool htab_grow(htab_t *h) {
+    htab_migrate(h, h->old_size);
 
-    // hash key and place item in appropriate bucket
-    size_t bucket = htab_index(h, key);
-    newhead->next = h->buckets[bucket];
-    h->buckets[bucket] = newhead;
+    item_t *slots = (item_t *)calloc(h->size * 2, sizeof(item_t));
+    if (slots == NULL)
+    {
+        return false;
+    }
+
+    h->old_slots = h->slots;
+    h->old_size = h->size;
+    h->migrate_pos = 0;
+    h->slots = slots;
+    h->size *= 2;
     return true;
 }
 
-    // Print the hash table.
-void htab_print(htab_t *h) {
-    printf("hash table with %ld buckets\n", h->size);
-    for (size_t i = 0; i < h->size; ++i)
+    // Add a key with value to the hash table. Adding a key that is already
+    // present replaces its value.
+bool htab_add(htab_t *h, char *key, int value) {
+    uint64_t id = htab_key(key);
+    if (id == 0)
     {
-        printf("bucket %ld: ", i);
-        if (h->buckets[i] == NULL)
+        return false;
+    }
+
+    htab_migrate(h, HTAB_MIGRATE_STEP);
+
+    item_t *i = &h->slots[htab_probe(h->slots, h->size, id)];
+    if (i->id == 0)
+    {
+        // not moved over yet, take it out of the previous array
+        item_t *old = htab_find_old(h, id);
+        if (old != NULL)
         {
-            printf("empty\n");
+            old->id = HTAB_TOMBSTONE;
         }
         else
         {
-            for (item_t *j = h->buckets[i]; j != NULL; j = j->next)
+            if ((h->count + 1) * HTAB_MAX_LOAD_DEN > h->size * HTAB_MAX_LOAD_NUM)
             {
-                item_print(j);
-                if (j->next != NULL)
+                if (!htab_grow(h))
                 {
-                    printf(" -> ");
+                    return false;
                 }
+                i = &h->slots[htab_probe(h->slots, h->size, id)];
             }
-            printf("\n");
+            ++h->count;
+        }
+        i->id = id;
+    }
+    i->value = value;
+    return true;
+}
+
+    // Iterate over every item: the current slot array, then whatever has
+    // not been moved over from the previous one yet.
+item_t *htab_next(htab_t *h, size_t *cursor) {
+    for (; *cursor < h->size; ++*cursor)
+    {
+        if (h->slots[*cursor].id != 0)
+        {
+            return &h->slots[(*cursor)++];
+        }
+    }
+
+    while (h->old_slots != NULL && *cursor - h->size < h->old_size)
+    {
+        size_t s = *cursor - h->size;
+        ++*cursor;
+        if (s >= h->migrate_pos && htab_live(&h->old_slots[s]))
+        {
+            return &h->old_slots[s];
+        }
+    }
+
+    return NULL;
+}
+
+    // Slots read to reach slot s when probing for id.
+static size_t htab_probe_length(size_t size, size_t s, uint64_t id) {
+    return ((s - htab_hash(id)) & (size - 1)) + 1;
+}
+
+    // Measure the load and probe lengths of the hash table.
+void htab_stats(htab_t *h, htab_stats_t *stats) {
+    memset(stats, 0, sizeof(htab_stats_t));
+    stats->size = h->size + h->old_size;
+    stats->count = h->count;
+    stats->load_factor = (double)h->count / h->size;
+    stats->migrate_remaining = h->old_slots != NULL ? h->old_size - h->migrate_pos : 0;
+
+    size_t total_probe = 0;
+    size_t cursor = 0;
+    for (item_t *i = htab_next(h, &cursor); i != NULL; i = htab_next(h, &cursor))
+    {
+        size_t probe;
+        if (i >= h->slots && i < h->slots + h->size)
+        {
+            probe = htab_probe_length(h->size, i - h->slots, i->id);
+        }
+        else
+        {
+            // missed in the current array first, then probed the previous one
+            probe = htab_probe_length(h->old_size, i - h->old_slots, i->id)
+                + htab_probe_length(h->size, htab_probe(h->slots, h->size, i->id), i->id);
+        }
+
+        total_probe += probe;
+        if (probe > stats->max_probe)
+        {
+            stats->max_probe = probe;
+        }
+        ++stats->histogram[probe - 1 < HTAB_HISTOGRAM_BINS ? probe - 1 : HTAB_HISTOGRAM_BINS - 1];
+    }
+
+    stats->mean_probe = h->count > 0 ? (double)total_probe / h->count : 0;
+}
+
+    // Print a summary of the hash table.
+void htab_print(htab_t *h) {
+    htab_stats_t stats;
+    htab_stats(h, &stats);
+
+    printf("hash table with %ld slots, %ld items, load %.2f\n", h->size, stats.count, stats.load_factor);
+    if (stats.migrate_remaining > 0)
+    {
+        printf("growing, %ld old slots left to move\n", stats.migrate_remaining);
+    }
+    printf("probe length mean %.2f, max %ld\n", stats.mean_probe, stats.max_probe);
+    for (size_t b = 0; b < HTAB_HISTOGRAM_BINS; ++b)
+    {
+        if (stats.histogram[b] > 0)
+        {
+            printf("%s%2ld: %ld\n", b + 1 < HTAB_HISTOGRAM_BINS ? " " : ">=", b + 1, stats.histogram[b]);
         }
     }
 }
 
     // Delete an item with key from the hash table.
+    // Uses backward shift deletion, so no tombstones are left behind
+    // (except in the previous slot array while growing).
 void htab_delete(htab_t *h, char *key) {
-    item_t *head = htab_bucket(h, key);
-    item_t *current = head;
-    item_t *previous = NULL;
-    while (current != NULL)
+    uint64_t id = htab_key(key);
+    if (id == 0)
     {
-        if (strcmp(current->key, key) == 0)
+        return;
+    }
+
+    htab_migrate(h, HTAB_MIGRATE_STEP);
+
+    // a moved item also has a stale copy in the previous array
+    bool found = false;
+    item_t *old = htab_find_old(h, id);
+    if (old != NULL)
+    {
+        old->id = HTAB_TOMBSTONE;
+        found = true;
+    }
+
+    size_t mask = h->size - 1;
+    size_t hole = htab_probe(h->slots, h->size, id);
+    if (h->slots[hole].id != 0)
+    {
+        // pull back later items of the probe run that may live in the hole
+        for (size_t s = (hole + 1) & mask; h->slots[s].id != 0; s = (s + 1) & mask)
         {
-            if (previous == NULL)
-            { // first item in list
-                h->buckets[htab_index(h, key)] = current->next;
-            }
-            else
+            size_t home = htab_hash(h->slots[s].id) & mask;
+            // the item may move only if its home is not cyclically in (hole, s]
+            if (((s - home) & mask) >= ((s - hole) & mask))
             {
-                previous->next = current->next;
+                h->slots[hole] = h->slots[s];
+                hole = s;
             }
-            free(current);
-            break;
         }
-        previous = current;
-        current = current->next;
+        memset(&h->slots[hole], 0, sizeof(item_t));
+        found = true;
     }
-}
 
-    // Destroy an initialised hash table.
-void htab_destroy(htab_t *h) {
-    // free linked lists
-    for (size_t i = 0; i < h->size; ++i)
+    if (found)
     {
-        item_t *bucket = h->buckets[i];
-        while (bucket != NULL)
-        {
-            item_t *next = bucket->next;
-            free(bucket);
-            bucket = next;
-        }
+        --h->count;
     }
+}
 
-    // free buckets array
-    free(h->buckets);
-    h->buckets = NULL;
+    // Destroy an initialised hash table.
+void htab_destroy(htab_t *h) {
+    // free slot arrays
+    free(h->slots);
+    free(h->old_slots);
+    h->slots = NULL;
+    h->old_slots = NULL;
     h->size = 0;
-}
\ No newline at end of file
+    h->old_size = 0;
+    h->count = 0;
+}
@@ -7,17 +7,53 @@
 #include <stdlib.h>
 #include <stdio.h>
 
+    // Longest key that can be stored inline in an item (a license plate).
+#define HTAB_KEY_LENGTH 6
+    // Grow once more than 3/4 of the slots would be used.
+#define HTAB_MAX_LOAD_NUM 3
+#define HTAB_MAX_LOAD_DEN 4
+    // Slots of the previous array moved over by each add or delete while growing.
+#define HTAB_MIGRATE_STEP 4
+    // Bins of the probe length histogram, the last one counts every longer probe.
+#define HTAB_HISTOGRAM_BINS 16
+    // Keys hashed, and whose home slots are fetched, together by the batch calls.
+#define HTAB_BATCH 8
+
 typedef struct item item_t;
 struct item {
-    char *key;
+    union {
+        char key[sizeof(uint64_t)]; // NUL padded, so always a valid string.
+        uint64_t id;                // Same bytes, compared as one integer.
+    };
     int value;
-    item_t *next;
 };
-    // A hash table mapping a string to an integer.
+    // A hash table mapping a string of up to HTAB_KEY_LENGTH chars to an integer.
+    // Open addressing with linear probing: all items live inline in one
+    // contiguous array of slots, an empty slot has id == 0.
+    // When it fills up, a slot array twice the size is allocated and items are
+    // moved over a few at a time by later adds and deletes, so no single
+    // operation pays for the whole resize. Until then both arrays are searched.
 typedef struct htab htab_t;
 struct htab {
-    item_t **buckets;
+    item_t *slots;
+    size_t size;    // number of slots, always a power of two
+    size_t count;   // number of items, in both slot arrays
+
+    item_t *old_slots;  // previous slot array while growing, else NULL
+    size_t old_size;
+    size_t migrate_pos; // old slots below this have been moved over
+};
+
+    // A snapshot of how full a hash table is and how long its probes are.
+typedef struct htab_stats htab_stats_t;
+struct htab_stats {
     size_t size;
+    size_t count;
+    double load_factor;
+    size_t max_probe;       // most slots read to find an item
+    double mean_probe;
+    size_t histogram[HTAB_HISTOGRAM_BINS]; // items found after reading i + 1 slots
+    size_t migrate_remaining; // old slots still to move over, 0 if not growing
 };
 
 
@@ -27,20 +63,55 @@ bool htab_init(htab_t *h, size_t n);
 
 size_t djb_hash(char *s);
 
-size_t htab_index(htab_t *h, char *key);
+uint64_t htab_key(const char *key);
 
-item_t *htab_bucket(htab_t *h, char *key);
+size_t htab_hash(uint64_t id);
+
+/**
+ * @brief Hash n packed keys, with AVX2 when built for it (make SIMD=1).
+ * The hashes are the same as from `htab_hash()` either way.
+ */
+void htab_hash_batch(const uint64_t *ids, size_t n, size_t *hashes);
+
+size_t htab_index(htab_t *h, char *key);
 
 item_t *htab_bucket(htab_t *h, char *key);
 
+/**
+ * @brief Find an item for key in hash table.
+ *
+ * @returns Pointer to the item inside the table, or NULL if not found.
+ * The pointer is only valid until the next `htab_add()` or `htab_delete()`.
+ */
 item_t *htab_find(htab_t *h, char *key);
 
+/**
+ * @brief Find the values of n packed keys (see `htab_key()`) at once.
+ * Keys are hashed HTAB_BATCH at a time and their home slots fetched
+ * before any is probed, so cache misses overlap instead of queueing.
+ *
+ * @param values Filled with the value of each key, or -1 if not found.
+ *
+ * @returns The number of keys found.
+ */
+size_t htab_find_batch(const htab_t *h, const uint64_t *ids, size_t n, int *values);
+
 bool htab_add(htab_t *h, char *key, int value);
 
+/**
+ * @brief Iterate over every item, in no particular order.
+ * Start with *cursor = 0, the table must not change while iterating.
+ *
+ * @returns The next item, or NULL once every item has been visited.
+ */
+item_t *htab_next(htab_t *h, size_t *cursor);
+
+void htab_stats(htab_t *h, htab_stats_t *stats);
+
 void htab_print(htab_t *h);
 
 void htab_delete(htab_t *h, char *key);
 
 void htab_destroy(htab_t *h);
 
-#endif //HTAB_H
\ No newline at end of file
+#endif //HTAB_H
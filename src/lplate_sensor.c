@@ -0,0 +1,81 @@
+#include <sched.h>
+#include <limits.h>
+#include "futex.h"
+#include "lplate_sensor.h"
+
+void lplate_sensor_init(license_plate_sensor_t *lps)
+{
+    atomic_init(&lps->lplate_sensor_reserved, 0);
+    atomic_init(&lps->lplate_sensor_sequence, 0);
+    atomic_init(&lps->lplate_sensor_consumed, 0);
+    atomic_init(&lps->lplate_sensor_reader_waiting, 0);
+    atomic_init(&lps->lplate_sensor_writers_waiting, 0);
+}
+
+/*
+ * function lplate_sensor_trigger(): write a plate to the next slot of a
+ * sensor and wake the manager if it sleeps on it.
+ * algorithm: the reserved count hands out slots. A writer sleeps on the
+ *            consumed count while its slot still holds an unread plate, and
+ *            publishes by bumping the sequence once every writer with an
+ *            earlier slot has. Each side counts itself a waiter before
+ *            rechecking the count it sleeps on, and the other side checks
+ *            for waiters after changing that count (all seq_cst), so either
+ *            the sleeper sees the change or the changer sees the sleeper.
+ */
+void lplate_sensor_trigger(license_plate_sensor_t *lps, const char *lplate)
+{
+    uint32_t slot = atomic_fetch_add(&lps->lplate_sensor_reserved, 1);
+
+    /* Wait for the manager to read the plate this slot held last time round: */
+    uint32_t consumed;
+    while(slot - (consumed = atomic_load_explicit(&lps->lplate_sensor_consumed, memory_order_acquire)) >= LPLATE_SENSOR_SLOTS)
+    {
+        atomic_fetch_add(&lps->lplate_sensor_writers_waiting, 1);
+        if(atomic_load(&lps->lplate_sensor_consumed) == consumed)
+        {
+            futex_wait_shared(&lps->lplate_sensor_consumed, consumed);
+        }
+        atomic_fetch_sub(&lps->lplate_sensor_writers_waiting, 1);
+    }
+
+    memcpy(lps->license_plate[slot % LPLATE_SENSOR_SLOTS], lplate, sizeof(char) * LICENSE_PLATE_LENGTH);
+
+    /* Publish in slot order. Writers of earlier slots had room, so they are only copying: */
+    while(atomic_load_explicit(&lps->lplate_sensor_sequence, memory_order_relaxed) != slot)
+    {
+        sched_yield();
+    }
+    atomic_store(&lps->lplate_sensor_sequence, slot + 1);
+
+    if(atomic_load(&lps->lplate_sensor_reader_waiting) != 0)
+    {
+        futex_wake_shared(&lps->lplate_sensor_sequence, 1);
+    }
+}
+
+void lplate_sensor_read(license_plate_sensor_t *lplate_sensor, char *lplate)
+{
+    /* Only this thread changes the consumed count: */
+    uint32_t consumed = atomic_load_explicit(&lplate_sensor->lplate_sensor_consumed, memory_order_relaxed);
+
+    /* Wait for a plate we haven't read: */
+    while(atomic_load_explicit(&lplate_sensor->lplate_sensor_sequence, memory_order_acquire) == consumed)
+    {
+        atomic_store(&lplate_sensor->lplate_sensor_reader_waiting, 1);
+        if(atomic_load(&lplate_sensor->lplate_sensor_sequence) == consumed)
+        {
+            futex_wait_shared(&lplate_sensor->lplate_sensor_sequence, consumed);
+        }
+        atomic_store(&lplate_sensor->lplate_sensor_reader_waiting, 0);
+    }
+
+    /* Copy the license plate into the given buffer, then hand its slot back to the writers: */
+    memcpy(lplate, lplate_sensor->license_plate[consumed % LPLATE_SENSOR_SLOTS], sizeof(char) * LICENSE_PLATE_LENGTH);
+    atomic_store(&lplate_sensor->lplate_sensor_consumed, consumed + 1);
+
+    if(atomic_load(&lplate_sensor->lplate_sensor_writers_waiting) != 0)
+    {
+        futex_wake_shared(&lplate_sensor->lplate_sensor_consumed, INT_MAX);
+    }
+}
@@ -0,0 +1,32 @@
+#ifndef  LPLATE_SENSOR_H
+#define  LPLATE_SENSOR_H
+
+#include "shared_memory.h"
+
+/**
+ * @brief Empty a license plate sensor, before either process uses it.
+ */
+void lplate_sensor_init(license_plate_sensor_t *lps);
+
+/**
+ * @brief Use this from the simulator to have a sensor read a plate. Any
+ * number of threads may trigger a sensor at once, their plates are read in
+ * the order they claimed slots. Only waits if LPLATE_SENSOR_SLOTS plates are
+ * still unread, and only makes a system call to wake a sleeping manager or
+ * to sleep itself.
+ */
+void lplate_sensor_trigger(license_plate_sensor_t *lps, const char *lplate);
+
+/**
+ * @brief This function will wait for the given LPS to read a new license plate,
+ * then return. Plates are returned once each, oldest first, so one triggered
+ * while the manager was busy with the last is returned by the next call
+ * rather than lost. Only sleeping costs a system call.
+ * Use this function from within the manager, in a loop function, that will handle
+ * behaviour for entrances, levels or exits. Only one thread may read a sensor.
+ *
+ * @param lplate_sensor Pointer to the license plate reader's structure.
+ */
+void lplate_sensor_read(license_plate_sensor_t *lplate_sensor, char *lplate);
+
+#endif //LPLATE_SENSOR_H
@@ -0,0 +1,180 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include "lplate_sensor.h"
+
+/* Stress test for license plate sensors: bursts of plates triggered before
+   the reader gets to them, then writer threads in another process racing
+   one reader, as the simulator's cars do the manager. Every plate must be
+   read once, in each writer's order.
+   Usage: lplate_sensor_stress.out [writers] [plates per writer] */
+
+#define STRESS_WRITERS 4
+#define STRESS_PLATES 200000
+    // Writers are told apart by the first letter of their plates
+#define STRESS_MAX_WRITERS 26
+
+typedef struct stress_writer_t
+{
+    license_plate_sensor_t *lps;
+    int writer;
+    long plates;
+} stress_writer_t;
+
+/**
+ * @brief Write plate i of a writer, its letter then i as 5 digits.
+ */
+static void stress_plate(int writer, long i, char plate[LICENSE_PLATE_LENGTH + 1])
+{
+    plate[0] = 'A' + writer;
+    for(int d = LICENSE_PLATE_LENGTH - 1; d > 0; --d, i /= 10)
+    {
+        plate[d] = '0' + i % 10;
+    }
+    plate[LICENSE_PLATE_LENGTH] = '\0';
+}
+
+static double stress_now(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+/**
+ * @brief Trigger a full sensor's worth of plates, then read them all back.
+ * Starts the counts just short of wrapping, so the slots must follow on.
+ *
+ * @returns false if a plate was lost or read out of order.
+ */
+static bool stress_burst(license_plate_sensor_t *lps)
+{
+    char plate[LICENSE_PLATE_LENGTH + 1], read[LICENSE_PLATE_LENGTH + 1] = {0};
+    long errors = 0;
+
+    lplate_sensor_init(lps);
+    atomic_store(&lps->lplate_sensor_reserved, UINT32_MAX - LPLATE_SENSOR_SLOTS / 2);
+    atomic_store(&lps->lplate_sensor_sequence, UINT32_MAX - LPLATE_SENSOR_SLOTS / 2);
+    atomic_store(&lps->lplate_sensor_consumed, UINT32_MAX - LPLATE_SENSOR_SLOTS / 2);
+
+    for(int round = 0; round < 3; ++round)
+    {
+        for(long i = 0; i < LPLATE_SENSOR_SLOTS; ++i)
+        {
+            stress_plate(0, i, plate);
+            lplate_sensor_trigger(lps, plate);
+        }
+        for(long i = 0; i < LPLATE_SENSOR_SLOTS; ++i)
+        {
+            stress_plate(0, i, plate);
+            lplate_sensor_read(lps, read);
+            errors += strcmp(plate, read) != 0;
+        }
+    }
+
+    printf("burst          %d plates before each read: %ld errors\n", LPLATE_SENSOR_SLOTS, errors);
+    return errors == 0;
+}
+
+static void *stress_write_loop(void *args)
+{
+    stress_writer_t *writer_args = (stress_writer_t *)args;
+    char plate[LICENSE_PLATE_LENGTH + 1];
+
+    for(long i = 0; i < writer_args->plates; ++i)
+    {
+        stress_plate(writer_args->writer, i, plate);
+        lplate_sensor_trigger(writer_args->lps, plate);
+    }
+    return NULL;
+}
+
+/**
+ * @brief Trigger plates from writer threads of a child process while this
+ * one reads them, and print the throughput.
+ *
+ * @returns false if a plate was lost or read out of order.
+ */
+static bool stress_race(license_plate_sensor_t *lps, int num_writers, long plates)
+{
+    lplate_sensor_init(lps);
+
+    double start = stress_now();
+    pid_t child = fork();
+    if(child < 0)
+    {
+        return false;
+    }
+    if(child == 0)
+    {
+        pthread_t writers[STRESS_MAX_WRITERS];
+        stress_writer_t writer_args[STRESS_MAX_WRITERS];
+        for(int w = 0; w < num_writers; ++w)
+        {
+            writer_args[w] = (stress_writer_t){ lps, w, plates };
+            pthread_create(&writers[w], NULL, stress_write_loop, &writer_args[w]);
+        }
+        for(int w = 0; w < num_writers; ++w)
+        {
+            pthread_join(writers[w], NULL);
+        }
+        _exit(EXIT_SUCCESS);
+    }
+
+    /* Each writer's plates must come in the order it triggered them: */
+    long next[STRESS_MAX_WRITERS] = {0};
+    long errors = 0;
+    char read[LICENSE_PLATE_LENGTH + 1] = {0}, expected[LICENSE_PLATE_LENGTH + 1];
+    for(long p = 0; p < num_writers * plates; ++p)
+    {
+        lplate_sensor_read(lps, read);
+        int w = read[0] - 'A';
+        if(w < 0 || w >= num_writers)
+        {
+            ++errors;
+            continue;
+        }
+        stress_plate(w, next[w]++, expected);
+        errors += strcmp(read, expected) != 0;
+    }
+
+    int status;
+    waitpid(child, &status, 0);
+    double elapsed = stress_now() - start;
+
+    printf("race           %2d writers: %8.2f M plates/s, %ld errors\n",
+        num_writers, num_writers * plates / elapsed / 1e6, errors);
+    return errors == 0 && WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS;
+}
+
+int main(int argc, char **argv)
+{
+    int num_writers = argc > 1 ? atoi(argv[1]) : STRESS_WRITERS;
+    long plates = argc > 2 ? atol(argv[2]) : STRESS_PLATES;
+    if(num_writers < 1 || num_writers > STRESS_MAX_WRITERS || plates < 1)
+    {
+        fprintf(stderr, "usage: %s [writers, 1 to %d] [plates per writer]\n", argv[0], STRESS_MAX_WRITERS);
+        return EXIT_FAILURE;
+    }
+
+    /* Shared with the writers' process, as the simulator's memory is with the manager: */
+    license_plate_sensor_t *lps = (license_plate_sensor_t *)mmap(NULL, sizeof(license_plate_sensor_t),
+        PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if(lps == MAP_FAILED)
+    {
+        return EXIT_FAILURE;
+    }
+
+    bool ok = stress_burst(lps) && stress_race(lps, num_writers, plates);
+
+    munmap(lps, sizeof(license_plate_sensor_t));
+
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,284 @@
+#include "mph.h"
+
+/* Average number of keys per bucket, CHD's lambda. Kept low so enough
+   singleton buckets are left to fill the last free slots directly: */
+#define MPH_BUCKET_LOAD 2
+/* Seeds tried before giving up on a key set: */
+#define MPH_MAX_ATTEMPTS 16
+
+typedef struct mph_hash_t
+{
+    size_t bucket;
+    uint64_t f1;
+    uint64_t f2;
+} mph_hash_t;
+
+static uint64_t mph_mix(uint64_t x)
+{
+    /* splitmix64 finaliser: */
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+static mph_hash_t mph_hash(const mph_t *self, uint64_t id)
+{
+    uint64_t h1 = mph_mix(id ^ self->seed);
+    uint64_t h2 = mph_mix(h1 ^ id);
+
+    mph_hash_t h;
+    h.bucket = (h1 >> 32) % self->num_buckets;
+    h.f1 = (h1 & 0xffffffffULL) % self->num_keys;
+    h.f2 = h2 % self->num_keys;
+    return h;
+}
+
+static size_t mph_position(const mph_t *self, mph_hash_t h, uint32_t disp)
+{
+    uint64_t d0 = disp / self->num_keys;
+    uint64_t d1 = disp % self->num_keys;
+    return (h.f1 + d0 * h.f2 + d1) % self->num_keys;
+}
+
+/**
+ * @brief Try to place every bucket with the current seed.
+ * Buckets are placed largest first, each taking the first displacement
+ * that lands all of its keys on free, distinct slots.
+ */
+static bool mph_try_build(mph_t *self, const uint64_t *keys, const int *values, size_t n,
+    mph_hash_t *hashes, size_t *members, size_t *bucket_start, size_t *order, uint8_t *taken)
+{
+    size_t r = self->num_buckets;
+    size_t max_bucket = 0;
+
+    /* Hash every key and count bucket sizes: */
+    memset(bucket_start, 0, (r + 1) * sizeof(size_t));
+    for(size_t i = 0; i < n; ++i)
+    {
+        hashes[i] = mph_hash(self, keys[i]);
+        ++bucket_start[hashes[i].bucket + 1];
+    }
+    for(size_t b = 0; b < r; ++b)
+    {
+        size_t size = bucket_start[b + 1];
+        if(size > max_bucket)
+        {
+            max_bucket = size;
+        }
+        bucket_start[b + 1] += bucket_start[b];
+    }
+
+    /* Group keys by bucket (bucket_start[b] is used as a fill cursor, then restored): */
+    for(size_t i = 0; i < n; ++i)
+    {
+        members[bucket_start[hashes[i].bucket]++] = i;
+    }
+    for(size_t b = r; b > 0; --b)
+    {
+        bucket_start[b] = bucket_start[b - 1];
+    }
+    bucket_start[0] = 0;
+
+    /* Order buckets by descending size (counting sort): */
+    size_t *size_start = (size_t *)calloc(max_bucket + 2, sizeof(size_t));
+    if(size_start == NULL)
+    {
+        return false;
+    }
+    for(size_t b = 0; b < r; ++b)
+    {
+        ++size_start[max_bucket - (bucket_start[b + 1] - bucket_start[b]) + 1];
+    }
+    for(size_t s = 0; s <= max_bucket; ++s)
+    {
+        size_start[s + 1] += size_start[s];
+    }
+    for(size_t b = 0; b < r; ++b)
+    {
+        order[size_start[max_bucket - (bucket_start[b + 1] - bucket_start[b])]++] = b;
+    }
+    free(size_start);
+
+    /* Place buckets: */
+    memset(taken, 0, n);
+    size_t positions[64];
+    size_t free_cursor = 0;
+    uint64_t max_disp = (uint64_t)n * 64;
+    if(max_disp > UINT32_MAX)
+    {
+        max_disp = UINT32_MAX;
+    }
+    for(size_t o = 0; o < r; ++o)
+    {
+        size_t b = order[o];
+        size_t size = bucket_start[b + 1] - bucket_start[b];
+        if(size == 0)
+        { /* Remaining buckets are all empty. */
+            break;
+        }
+        if(size > sizeof(positions) / sizeof(positions[0]))
+        { /* Pathological seed, try another. */
+            return false;
+        }
+
+        if(size == 1)
+        { /* Singletons come last, give each the next free slot directly (d0 = 0): */
+            while(taken[free_cursor])
+            {
+                ++free_cursor;
+            }
+            size_t i = members[bucket_start[b]];
+            self->disp[b] = (uint32_t)((free_cursor + n - hashes[i].f1) % n);
+            taken[free_cursor] = 1;
+            self->keys[free_cursor] = keys[i];
+            self->values[free_cursor] = values[i];
+            continue;
+        }
+
+        bool placed = false;
+        for(uint64_t d = 0; d < max_disp && !placed; ++d)
+        {
+            placed = true;
+            for(size_t k = 0; k < size && placed; ++k)
+            {
+                size_t pos = mph_position(self, hashes[members[bucket_start[b] + k]], (uint32_t)d);
+                if(taken[pos])
+                {
+                    placed = false;
+                }
+                for(size_t j = 0; j < k && placed; ++j)
+                {
+                    if(positions[j] == pos)
+                    {
+                        placed = false;
+                    }
+                }
+                positions[k] = pos;
+            }
+
+            if(placed)
+            {
+                self->disp[b] = (uint32_t)d;
+                for(size_t k = 0; k < size; ++k)
+                {
+                    size_t i = members[bucket_start[b] + k];
+                    taken[positions[k]] = 1;
+                    self->keys[positions[k]] = keys[i];
+                    self->values[positions[k]] = values[i];
+                }
+            }
+        }
+
+        if(!placed)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool mph_build(mph_t *self, const uint64_t *keys, const int *values, size_t n)
+{
+    memset(self, 0, sizeof(mph_t));
+    self->num_keys = n;
+    self->num_buckets = n / MPH_BUCKET_LOAD + 1;
+    if(n == 0)
+    {
+        return true;
+    }
+
+    self->disp = (uint32_t *)calloc(self->num_buckets, sizeof(uint32_t));
+    self->keys = (uint64_t *)malloc(n * sizeof(uint64_t));
+    self->values = (int *)malloc(n * sizeof(int));
+
+    /* Scratch space for building: */
+    mph_hash_t *hashes = (mph_hash_t *)malloc(n * sizeof(mph_hash_t));
+    size_t *members = (size_t *)malloc(n * sizeof(size_t));
+    size_t *bucket_start = (size_t *)malloc((self->num_buckets + 1) * sizeof(size_t));
+    size_t *order = (size_t *)malloc(self->num_buckets * sizeof(size_t));
+    uint8_t *taken = (uint8_t *)malloc(n);
+
+    bool built = false;
+    if(self->disp != NULL && self->keys != NULL && self->values != NULL && hashes != NULL
+        && members != NULL && bucket_start != NULL && order != NULL && taken != NULL)
+    {
+        for(uint64_t attempt = 0; attempt < MPH_MAX_ATTEMPTS && !built; ++attempt)
+        {
+            self->seed = mph_mix(attempt);
+            built = mph_try_build(self, keys, values, n, hashes, members, bucket_start, order, taken);
+        }
+    }
+
+    free(hashes);
+    free(members);
+    free(bucket_start);
+    free(order);
+    free(taken);
+
+    if(!built)
+    {
+        mph_destroy(self);
+    }
+    return built;
+}
+
+bool mph_build_from_htab(mph_t *self, htab_t *h)
+{
+    uint64_t *keys = (uint64_t *)malloc((h->count + 1) * sizeof(uint64_t));
+    int *values = (int *)malloc((h->count + 1) * sizeof(int));
+    if(keys == NULL || values == NULL)
+    {
+        free(keys);
+        free(values);
+        return false;
+    }
+
+    /* Collect every item: */
+    size_t n = 0;
+    size_t cursor = 0;
+    for(item_t *i = htab_next(h, &cursor); i != NULL; i = htab_next(h, &cursor))
+    {
+        keys[n] = i->id;
+        values[n] = i->value;
+        ++n;
+    }
+
+    bool built = mph_build(self, keys, values, n);
+    free(keys);
+    free(values);
+    return built;
+}
+
+long mph_slot(const mph_t *self, uint64_t id)
+{
+    if(self->num_keys == 0)
+    {
+        return -1;
+    }
+
+    mph_hash_t h = mph_hash(self, id);
+    size_t pos = mph_position(self, h, self->disp[h.bucket]);
+
+    /* A key outside the set still lands on some slot, so confirm it: */
+    return self->keys[pos] == id ? (long)pos : -1;
+}
+
+int mph_find(const mph_t *self, char *key)
+{
+    long slot = mph_slot(self, htab_key(key));
+    return slot >= 0 ? self->values[slot] : -1;
+}
+
+void mph_destroy(mph_t *self)
+{
+    free(self->disp);
+    free(self->keys);
+    free(self->values);
+    self->disp = NULL;
+    self->keys = NULL;
+    self->values = NULL;
+    self->num_keys = 0;
+    self->num_buckets = 0;
+}
@@ -0,0 +1,60 @@
+#ifndef  MPH_H
+#define  MPH_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include "htab.h"
+
+/**
+ * @brief A minimal perfect hash over a fixed set of keys (CHD, "compress,
+ * hash and displace"). Every key of the set maps to its own slot in [0, n),
+ * so a lookup is one hash plus one compare against the key stored in the slot.
+ * The slot number doubles as a dense ID for the key.
+ *
+ * The set cannot change after `mph_build()`, rebuild it instead.
+ */
+typedef struct mph_t
+{
+    uint64_t seed;
+    size_t num_keys;
+    size_t num_buckets;
+
+    /* Displacement chosen for each bucket, d0 * num_keys + d1: */
+    uint32_t *disp;
+
+    /* Key and value stored in each slot, in slot order: */
+    uint64_t *keys;
+    int *values;
+} mph_t;
+
+/**
+ * @brief Build a minimal perfect hash over n distinct packed keys (see `htab_key()`).
+ * values[i] is returned by `mph_find()` for keys[i].
+ *
+ * @returns False if out of memory or the keys are not distinct.
+ */
+bool mph_build(mph_t *self, const uint64_t *keys, const int *values, size_t n);
+
+/**
+ * @brief Build a minimal perfect hash over every item in a hash table.
+ */
+bool mph_build_from_htab(mph_t *self, htab_t *h);
+
+/**
+ * @brief Find the slot of a packed key.
+ *
+ * @returns Slot in [0, num_keys), usable as a dense ID, or -1 if the key is not in the set.
+ */
+long mph_slot(const mph_t *self, uint64_t id);
+
+/**
+ * @brief Find the value for key.
+ *
+ * @returns The value given at build time, or -1 if the key is not in the set.
+ */
+int mph_find(const mph_t *self, char *key);
+
+void mph_destroy(mph_t *self);
+
+#endif //MPH_H
@@ -0,0 +1,115 @@
+#include "plate_bitmap.h"
+
+int32_t plate_encode(const char *plate)
+{
+    int32_t code = 0;
+
+    /* Digits first, then letters, most significant first: */
+    for(uint8_t i = 0; i < 3; ++i)
+    {
+        if(plate[i] < '0' || plate[i] > '9')
+        {
+            return -1;
+        }
+        code = code * 10 + (plate[i] - '0');
+    }
+    for(uint8_t i = 3; i < 6; ++i)
+    {
+        if(plate[i] < 'A' || plate[i] > 'Z')
+        {
+            return -1;
+        }
+        code = code * 26 + (plate[i] - 'A');
+    }
+
+    return code;
+}
+
+void plate_decode(int32_t code, char *plate)
+{
+    for(int8_t i = 5; i >= 3; --i)
+    {
+        plate[i] = 'A' + code % 26;
+        code /= 26;
+    }
+    for(int8_t i = 2; i >= 0; --i)
+    {
+        plate[i] = '0' + code % 10;
+        code /= 10;
+    }
+}
+
+bool plate_bitmap_init(plate_bitmap_t *self, bool with_ids)
+{
+    self->bits = (uint64_t *)calloc((PLATE_CODE_COUNT + 63) / 64, sizeof(uint64_t));
+    self->ids = NULL;
+    if(with_ids)
+    {
+        self->ids = (int *)malloc(PLATE_CODE_COUNT * sizeof(int));
+    }
+
+    if(self->bits == NULL || (with_ids && self->ids == NULL))
+    {
+        plate_bitmap_destroy(self);
+        return false;
+    }
+
+    return true;
+}
+
+bool plate_bitmap_add(plate_bitmap_t *self, char *plate, int value)
+{
+    int32_t code = plate_encode(plate);
+    if(code < 0)
+    {
+        return false;
+    }
+
+    self->bits[code >> 6] |= 1ULL << (code & 63);
+    if(self->ids != NULL)
+    {
+        self->ids[code] = value;
+    }
+
+    return true;
+}
+
+bool plate_bitmap_build_from_htab(plate_bitmap_t *self, htab_t *h, bool with_ids)
+{
+    if(!plate_bitmap_init(self, with_ids))
+    {
+        return false;
+    }
+
+    size_t cursor = 0;
+    for(item_t *i = htab_next(h, &cursor); i != NULL; i = htab_next(h, &cursor))
+    { /* Plates that don't match stay in the table only. */
+        plate_bitmap_add(self, i->key, i->value);
+    }
+
+    return true;
+}
+
+int plate_bitmap_find(const plate_bitmap_t *self, char *plate)
+{
+    int32_t code = plate_encode(plate);
+    if(code < 0)
+    {
+        return PLATE_BITMAP_FALLBACK;
+    }
+
+    if(!((self->bits[code >> 6] >> (code & 63)) & 1))
+    { /* Not authorised. */
+        return -1;
+    }
+
+    return self->ids != NULL ? self->ids[code] : PLATE_BITMAP_FALLBACK;
+}
+
+void plate_bitmap_destroy(plate_bitmap_t *self)
+{
+    free(self->bits);
+    free(self->ids);
+    self->bits = NULL;
+    self->ids = NULL;
+}
@@ -0,0 +1,66 @@
+#ifndef  PLATE_BITMAP_H
+#define  PLATE_BITMAP_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include "htab.h"
+
+/* Plates are 3 digits followed by 3 uppercase letters: */
+#define PLATE_CODE_COUNT (1000 * 26 * 26 * 26)
+
+/* Returned by `plate_bitmap_find()` when the plate table must be asked instead: */
+#define PLATE_BITMAP_FALLBACK -2
+
+/**
+ * @brief Authorisation set indexed directly by plate code, one bit per
+ * possible plate (~2.2 MB). Optionally keeps a dense ID table next to it
+ * (one int per possible plate, ~70 MB) so the value needs no table lookup either.
+ */
+typedef struct plate_bitmap_t
+{
+    uint64_t *bits;
+    int *ids;
+} plate_bitmap_t;
+
+/**
+ * @brief Encode a plate as an integer in [0, PLATE_CODE_COUNT).
+ * Only the first 6 chars are read.
+ *
+ * @returns The plate code, or -1 if the plate is not 3 digits then 3 uppercase letters.
+ */
+int32_t plate_encode(const char *plate);
+
+/**
+ * @brief Decode a plate code back into 6 chars (not NUL terminated).
+ */
+void plate_decode(int32_t code, char *plate);
+
+bool plate_bitmap_init(plate_bitmap_t *self, bool with_ids);
+
+/**
+ * @brief Mark a plate as authorised.
+ *
+ * @returns False if the plate does not match the pattern, the caller must keep it
+ * in a plate table instead.
+ */
+bool plate_bitmap_add(plate_bitmap_t *self, char *plate, int value);
+
+/**
+ * @brief Initialise the bitmap with every plate in a hash table that
+ * matches the pattern. Other plates are left to the table.
+ */
+bool plate_bitmap_build_from_htab(plate_bitmap_t *self, htab_t *h, bool with_ids);
+
+/**
+ * @brief Check a plate with one bit test.
+ *
+ * @returns The plate's value if the ID table is kept, -1 if the plate is not
+ * authorised, or PLATE_BITMAP_FALLBACK if the plate does not match the pattern,
+ * or is authorised but there is no ID table. Then look it up in the plate table.
+ */
+int plate_bitmap_find(const plate_bitmap_t *self, char *plate);
+
+void plate_bitmap_destroy(plate_bitmap_t *self);
+
+#endif //PLATE_BITMAP_H
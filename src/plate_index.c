@@ -0,0 +1,187 @@
+#include "plate_index.h"
+
+#ifndef PLATE_BITMAP_IDS
+#define PLATE_BITMAP_IDS false
+#endif
+#ifndef PLATE_BLOOM_FPR
+#define PLATE_BLOOM_FPR 0.01
+#endif
+/* Plates whose previous values are looked up together on a reload: */
+#define PLATE_INDEX_BATCH 256
+
+/**
+ * @brief Add plate i of the arena to the table, with the value it had in the
+ * previous index, or a new value if old_value is -1.
+ */
+static bool plate_index_add(plate_index_t *self, size_t i, int old_value)
+{
+    char *plate = plate_arena_get(&self->plates, i);
+    if(htab_find(&self->table, plate) != NULL)
+    { /* Listed twice, keep the first value. */
+        return true;
+    }
+
+    return htab_add(&self->table, plate, old_value >= 0 ? old_value : self->next_value++);
+}
+
+/**
+ * @brief Add the first count plates of the arena to the table, looking
+ * their previous values up in batches, then asking other_value about misses.
+ */
+static bool plate_index_add_all(plate_index_t *self, const plate_index_t *previous,
+    int (*other_value)(const char *plate), size_t count)
+{
+    int old_values[PLATE_INDEX_BATCH];
+
+    for(size_t b = 0; b < count; b += PLATE_INDEX_BATCH)
+    {
+        size_t batch = count - b < PLATE_INDEX_BATCH ? count - b : PLATE_INDEX_BATCH;
+        if(previous != NULL)
+        {
+            htab_find_batch(&previous->table, &self->plates.plates[b], batch, old_values);
+        }
+        else
+        {
+            memset(old_values, 0xff, batch * sizeof(int)); /* All -1. */
+        }
+
+        for(size_t k = 0; k < batch; ++k)
+        {
+            if(old_values[k] < 0 && other_value != NULL)
+            {
+                old_values[k] = other_value(plate_arena_get(&self->plates, b + k));
+            }
+            if(!plate_index_add(self, b + k, old_values[k]))
+            {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+plate_index_t *plate_index_load(const char *path, const plate_index_t *previous, int next_value,
+    int (*other_value)(const char *plate), bool (*keep)(int value))
+{
+    plate_index_t *self = (plate_index_t *)calloc(1, sizeof(plate_index_t));
+    if(self == NULL)
+    {
+        return NULL;
+    }
+    self->next_value = next_value;
+
+    if(!plate_arena_init(&self->plates, previous != NULL ? previous->plates.count : 0)
+        || !plate_load_file(path, &self->plates, PLATE_LOADER_THREADS))
+    {
+        plate_index_free(self);
+        return NULL;
+    }
+
+    /* Leave room for plates carried over from the previous index: */
+    size_t file_count = self->plates.count;
+    if(!htab_init(&self->table, file_count + (previous != NULL ? previous->table.count : 0))
+        || !htab_init(&self->exit_only, 1))
+    {
+        plate_index_free(self);
+        return NULL;
+    }
+
+    bool ok = plate_index_add_all(self, previous, other_value, file_count);
+
+    /* Carry over dropped plates the caller still needs, for their cars to leave: */
+    size_t cursor = 0;
+    item_t *old = previous != NULL && keep != NULL ? htab_next((htab_t *)&previous->table, &cursor) : NULL;
+    for(; ok && old != NULL; old = htab_next((htab_t *)&previous->table, &cursor))
+    {
+        if(keep(old->value) && htab_find(&self->table, old->key) == NULL)
+        {
+            ok = plate_arena_push(&self->plates, old->id)
+                && plate_index_add(self, self->plates.count - 1, old->value)
+                && htab_add(&self->exit_only, old->key, old->value);
+        }
+    }
+
+#ifdef PLATE_MPH
+        /* Perfect hash over the plates, they don't change for the life of the index: */
+    ok = ok && mph_build_from_htab(&self->mph, &self->table);
+#endif
+#ifdef PLATE_BITMAP
+        /* Bitmap of the plates matching the plate pattern: */
+    ok = ok && plate_bitmap_build_from_htab(&self->bitmap, &self->table, PLATE_BITMAP_IDS);
+#endif
+#ifdef PLATE_BLOOM
+        /* Bloom filter in front of the table, to reject unauthorised plates early: */
+    ok = ok && bloom_init(&self->bloom, self->table.count, PLATE_BLOOM_FPR);
+    cursor = 0;
+    for(item_t *i = htab_next(&self->table, &cursor); ok && i != NULL; i = htab_next(&self->table, &cursor))
+    {
+        bloom_add(&self->bloom, i->id);
+    }
+#endif
+
+    if(!ok)
+    {
+        plate_index_free(self);
+        return NULL;
+    }
+
+    return self;
+}
+
+/**
+ * @brief Find the value of a plate in the table, or in the perfect hash built over it.
+ */
+static int plate_index_table_find(plate_index_t *self, char *plate)
+{
+#ifdef PLATE_MPH
+    /* Perfect hash, one hash and one compare: */
+    return mph_find(&self->mph, plate);
+#else
+    item_t *auth_car = htab_find(&self->table, plate);
+    return auth_car != NULL ? auth_car->value : -1;
+#endif
+}
+
+int plate_index_find(plate_index_t *self, char *plate)
+{
+#ifdef PLATE_BITMAP
+    /* One bit test, only ask the table for odd plates or a value: */
+    int bitmap_value = plate_bitmap_find(&self->bitmap, plate);
+    if(bitmap_value != PLATE_BITMAP_FALLBACK)
+    {
+        return bitmap_value;
+    }
+#endif
+
+#ifdef PLATE_BLOOM
+    /* Most unauthorised plates stop here after one cache line: */
+    if(!bloom_check(&self->bloom, htab_key(plate)))
+    {
+        bloom_record(&self->bloom, false, false);
+        return -1;
+    }
+
+    int value = plate_index_table_find(self, plate);
+    bloom_record(&self->bloom, true, value >= 0);
+    return value;
+#else
+    return plate_index_table_find(self, plate);
+#endif
+}
+
+bool plate_index_exit_only(plate_index_t *self, char *plate)
+{
+    return self->exit_only.count > 0 && htab_find(&self->exit_only, plate) != NULL;
+}
+
+void plate_index_free(plate_index_t *self)
+{
+    plate_arena_destroy(&self->plates);
+    htab_destroy(&self->table);
+    htab_destroy(&self->exit_only);
+    mph_destroy(&self->mph);
+    plate_bitmap_destroy(&self->bitmap);
+    bloom_destroy(&self->bloom);
+    free(self);
+}
@@ -0,0 +1,72 @@
+#ifndef  PLATE_INDEX_H
+#define  PLATE_INDEX_H
+
+#include <stdbool.h>
+#include "htab.h"
+#include "mph.h"
+#include "bloom.h"
+#include "plate_bitmap.h"
+#include "plate_loader.h"
+
+/**
+ * @brief Everything built from the authorised plate file: the plates
+ * themselves, the table mapping each plate to its value, and the optional
+ * perfect hash (PLATE_MPH), bitmap (PLATE_BITMAP) and Bloom filter
+ * (PLATE_BLOOM) built over that table.
+ *
+ * An index is never modified once built (apart from the filter's counters),
+ * so any number of threads can look plates up in it. To change the plate
+ * set, build a new index and swap it in.
+ */
+typedef struct plate_index_t
+{
+    plate_arena_t plates;
+    htab_t table;
+    htab_t exit_only;   /* Plates dropped from the file, kept until their car leaves. */
+    mph_t mph;
+    plate_bitmap_t bitmap;
+    bloom_t bloom;
+
+    /* Value after the last one this index gave a new plate. The caller
+       keeps the running count, this only seeds it: */
+    int next_value;
+} plate_index_t;
+
+/**
+ * @brief Build an index from a plate file.
+ *
+ * Plates already in `previous` keep their value, then those `other_value`
+ * knows (e.g. a plate's day pass) keep that one, and new plates get values
+ * from `next_value` up, so state kept per value stays valid across
+ * a reload. Plates of `previous` that are no longer in the file are kept
+ * if `keep(value)` is true, e.g. so a parked car can still leave, and
+ * marked exit-only (see plate_index_exit_only()).
+ * With no previous index and a next_value of 1, plate i of the file gets
+ * the value i + 1.
+ *
+ * @param previous Index being replaced, or NULL.
+ * @param next_value Value for the first new plate, above any value in use.
+ * @param other_value Value of a plate not in `previous`, or -1. May be NULL.
+ * @param keep May be NULL to drop every plate that is not in the file.
+ *
+ * @returns The new index, or NULL if the file could not be loaded.
+ */
+plate_index_t *plate_index_load(const char *path, const plate_index_t *previous, int next_value,
+    int (*other_value)(const char *plate), bool (*keep)(int value));
+
+/**
+ * @brief Find the value of a plate.
+ *
+ * @returns The plate's value, or -1 if it is not authorised.
+ */
+int plate_index_find(plate_index_t *self, char *plate);
+
+/**
+ * @brief Check if a plate is only in the index until its car leaves, so
+ * may leave but not enter.
+ */
+bool plate_index_exit_only(plate_index_t *self, char *plate);
+
+void plate_index_free(plate_index_t *self);
+
+#endif //PLATE_INDEX_H
@@ -0,0 +1,285 @@
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "plate_loader.h"
+
+/* format of the work given to a single parsing thread. */
+typedef struct plate_chunk_t
+{
+    const char *start;
+    const char *end;
+    plate_arena_t plates;
+    bool ok;
+} plate_chunk_t;
+
+bool plate_arena_init(plate_arena_t *self, size_t capacity)
+{
+    if(capacity == 0)
+    {
+        capacity = 1;
+    }
+
+    self->plates = (uint64_t *)malloc(capacity * sizeof(uint64_t));
+    self->count = 0;
+    self->capacity = capacity;
+
+    return self->plates != NULL;
+}
+
+void plate_arena_destroy(plate_arena_t *self)
+{
+    free(self->plates);
+    self->plates = NULL;
+    self->count = 0;
+    self->capacity = 0;
+}
+
+bool plate_arena_push(plate_arena_t *self, uint64_t plate)
+{
+    if(self->count == self->capacity)
+    {
+        /* Out of room, double the capacity: */
+        uint64_t *grown = (uint64_t *)realloc(self->plates, self->capacity * 2 * sizeof(uint64_t));
+        if(grown == NULL)
+        {
+            return false;
+        }
+        self->plates = grown;
+        self->capacity *= 2;
+    }
+
+    self->plates[self->count++] = plate;
+    return true;
+}
+
+char *plate_arena_get(plate_arena_t *self, size_t i)
+{
+    return (char *)&self->plates[i];
+}
+
+/**
+ * @brief Validate a single line and pack it.
+ *
+ * @returns The packed plate, or 0 if the line is not a valid plate.
+ */
+static uint64_t plate_parse_line(const char *line, size_t length)
+{
+    /* Ignore trailing whitespace, including a Windows line ending: */
+    while(length > 0 && (line[length - 1] == '\r' || line[length - 1] == ' ' || line[length - 1] == '\t'))
+    {
+        --length;
+    }
+    if(length != HTAB_KEY_LENGTH)
+    {
+        return 0;
+    }
+
+    char packed[sizeof(uint64_t)] = {0};
+    for(size_t i = 0; i < HTAB_KEY_LENGTH; ++i)
+    {
+        char c = line[i];
+        if(!(('0' <= c && c <= '9') || ('A' <= c && c <= 'Z') || ('a' <= c && c <= 'z')))
+        {
+            return 0;
+        }
+        packed[i] = c;
+    }
+
+    uint64_t plate;
+    memcpy(&plate, packed, sizeof(plate));
+    return plate;
+}
+
+/*
+ * function parse_chunk(): parse every line of one chunk of the plate file.
+ * input:     plate_chunk_t, its lines start at `start` and the last one
+ *            ends at or before `end`.
+ * output:    NULL, plates are left in the chunk's arena.
+ */
+static void *parse_chunk(void *args)
+{
+    plate_chunk_t *chunk = (plate_chunk_t *)args;
+
+    /* A plate line is about 7 bytes, so this rarely has to grow: */
+    chunk->ok = plate_arena_init(&chunk->plates, (chunk->end - chunk->start) / (HTAB_KEY_LENGTH + 1) + 1);
+
+    const char *line = chunk->start;
+    while(chunk->ok && line < chunk->end)
+    {
+        const char *newline = (const char *)memchr(line, '\n', chunk->end - line);
+        const char *line_end = newline != NULL ? newline : chunk->end;
+
+        uint64_t plate = plate_parse_line(line, line_end - line);
+        if(plate != 0)
+        {
+            chunk->ok = plate_arena_push(&chunk->plates, plate);
+        }
+
+        line = line_end + 1;
+    }
+
+    return NULL;
+}
+
+bool plate_load_file(const char *path, plate_arena_t *arena, unsigned num_threads)
+{
+    int fd = open(path, O_RDONLY);
+    if(fd == -1)
+    {
+        return false;
+    }
+
+    struct stat st;
+    if(fstat(fd, &st) == -1)
+    {
+        close(fd);
+        return false;
+    }
+    size_t size = (size_t)st.st_size;
+    if(size == 0)
+    { /* Nothing to read. */
+        close(fd);
+        return true;
+    }
+
+    /* Copy the file rather than map it, a mapping of a file rewritten in
+       place faults if it shrinks. If it changes size meanwhile, parse what
+       was read, the next reload picks up the rest: */
+    char *data = (char *)malloc(size);
+    size_t got = 0;
+    ssize_t n = 1;
+    while(data != NULL && got < size && n > 0)
+    {
+        n = read(fd, data + got, size - got);
+        got += n > 0 ? (size_t)n : 0;
+    }
+    close(fd);
+    if(data == NULL || n < 0 || got == 0)
+    {
+        free(data);
+        return data != NULL && n >= 0;
+    }
+    size = got;
+
+    /* Don't bother splitting small files: */
+    if(num_threads == 0)
+    {
+        num_threads = 1;
+    }
+    if(size / num_threads < PLATE_LOADER_MIN_CHUNK)
+    {
+        num_threads = size / PLATE_LOADER_MIN_CHUNK + 1;
+    }
+
+    plate_chunk_t *chunks = (plate_chunk_t *)calloc(num_threads, sizeof(plate_chunk_t));
+    pthread_t *threads = (pthread_t *)malloc(num_threads * sizeof(pthread_t));
+    if(chunks == NULL || threads == NULL)
+    {
+        free(chunks);
+        free(threads);
+        free(data);
+        return false;
+    }
+
+    /* Split at line boundaries, each chunk starts just after a newline: */
+    const char *end = data + size;
+    const char *start = data;
+    for(unsigned t = 0; t < num_threads; ++t)
+    {
+        const char *chunk_end = end;
+        if(t + 1 < num_threads)
+        {
+            chunk_end = data + size / num_threads * (t + 1);
+            if(chunk_end < start)
+            {
+                chunk_end = start;
+            }
+            const char *newline = (const char *)memchr(chunk_end, '\n', end - chunk_end);
+            chunk_end = newline != NULL ? newline + 1 : end;
+        }
+
+        chunks[t].start = start;
+        chunks[t].end = chunk_end;
+        start = chunk_end;
+    }
+
+    /* Parse chunks in parallel, this thread takes the first one. If a thread
+       can't be started, this thread parses its chunk and those after it too: */
+    unsigned started = 1;
+    while(started < num_threads && pthread_create(&threads[started], NULL, parse_chunk, &chunks[started]) == 0)
+    {
+        ++started;
+    }
+    parse_chunk(&chunks[0]);
+    for(unsigned t = started; t < num_threads; ++t)
+    {
+        parse_chunk(&chunks[t]);
+    }
+    for(unsigned t = 1; t < started; ++t)
+    {
+        pthread_join(threads[t], NULL);
+    }
+
+    /* Make room for every chunk at once: */
+    bool ok = true;
+    size_t total = arena->count;
+    for(unsigned t = 0; t < num_threads; ++t)
+    {
+        ok = ok && chunks[t].ok;
+        total += chunks[t].plates.count;
+    }
+    if(ok && total > arena->capacity)
+    {
+        uint64_t *grown = (uint64_t *)realloc(arena->plates, total * sizeof(uint64_t));
+        ok = grown != NULL;
+        if(ok)
+        {
+            arena->plates = grown;
+            arena->capacity = total;
+        }
+    }
+
+    /* Concatenate chunks in file order: */
+    for(unsigned t = 0; t < num_threads; ++t)
+    {
+        if(ok)
+        {
+            memcpy(&arena->plates[arena->count], chunks[t].plates.plates, chunks[t].plates.count * sizeof(uint64_t));
+            arena->count += chunks[t].plates.count;
+        }
+        plate_arena_destroy(&chunks[t].plates);
+    }
+
+    free(chunks);
+    free(threads);
+    free(data);
+
+    return ok;
+}
+
+bool plate_arena_build_htab(plate_arena_t *self, htab_t *h)
+{
+    if(!htab_init(h, self->count))
+    {
+        return false;
+    }
+
+    size_t mask = h->size - 1;
+    for(size_t i = 0; i < self->count; ++i)
+    {
+        /* Inserts are independent, so start fetching slots a few plates ahead: */
+        if(i + 16 < self->count)
+        {
+            __builtin_prefetch(&h->slots[htab_hash(self->plates[i + 16]) & mask], 1);
+        }
+
+        if(!htab_add(h, plate_arena_get(self, i), (int)(i + 1)))
+        {
+            htab_destroy(h);
+            return false;
+        }
+    }
+
+    return true;
+}
@@ -0,0 +1,60 @@
+#ifndef  PLATE_LOADER_H
+#define  PLATE_LOADER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include "htab.h"
+
+/* Threads used to parse a plate file: */
+#define PLATE_LOADER_THREADS 4
+/* Files smaller than this are parsed by one thread: */
+#define PLATE_LOADER_MIN_CHUNK (64 * 1024)
+
+/**
+ * @brief Growable arena of license plates. Each plate is packed into one
+ * integer with `htab_key()`, which keeps it NUL padded so it can also be
+ * read as a string with `plate_arena_get()`.
+ */
+typedef struct plate_arena_t
+{
+    uint64_t *plates;
+    size_t count;
+    size_t capacity;
+} plate_arena_t;
+
+bool plate_arena_init(plate_arena_t *self, size_t capacity);
+
+void plate_arena_destroy(plate_arena_t *self);
+
+/**
+ * @brief Add a packed plate to the end of the arena, growing it if needed.
+ */
+bool plate_arena_push(plate_arena_t *self, uint64_t plate);
+
+/**
+ * @brief Read plate i of the arena as a NUL terminated string.
+ */
+char *plate_arena_get(plate_arena_t *self, size_t i);
+
+/**
+ * @brief Load every valid plate of a file into an (initialised) arena, in file order.
+ * The file is read into memory and split into chunks at line boundaries,
+ * which are validated and parsed in parallel. Lines that are not exactly
+ * HTAB_KEY_LENGTH letters or digits are skipped.
+ *
+ * @param num_threads Maximum number of parsing threads.
+ *
+ * @returns False if the file could not be read or out of memory.
+ */
+bool plate_load_file(const char *path, plate_arena_t *arena, unsigned num_threads);
+
+/**
+ * @brief Initialise a hash table sized for every plate in the arena and add them
+ * in one pass. Plate i is given the value i + 1.
+ *
+ * @returns False if out of memory, with nothing left to destroy.
+ */
+bool plate_arena_build_htab(plate_arena_t *self, htab_t *h);
+
+#endif //PLATE_LOADER_H
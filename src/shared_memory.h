@@ -2,6 +2,7 @@
 #define  SHARED_MEMORY_H
 #include <stdint.h>
 #include <stdbool.h>
+#include <stdatomic.h>
 #include <string.h>
 #include <pthread.h>
 #include <semaphore.h>
@@ -18,11 +19,23 @@
 #define SEM_LOCAL 0
 #define SEM_SHARED 1
 
+    // Plates a sensor holds until the manager reads them, a power of two so
+    // slots follow on when the counts wrap
+#define LPLATE_SENSOR_SLOTS 16
+
+/* format of a license plate sensor, a ring of plates from the simulator's
+   threads to one manager thread. The counts run freely, a plate's slot is
+   its count modulo LPLATE_SENSOR_SLOTS. The manager sleeps on the sequence
+   and writers on the consumed count, each with a futex, and are only woken
+   if marked waiting. */
 typedef struct license_plate_sensor_t
 {
-    pthread_mutex_t lplate_sensor_mutex;
-    pthread_cond_t lplate_sensor_update_flag;
-    char license_plate[LICENSE_PLATE_LENGTH];
+    _Atomic uint32_t lplate_sensor_reserved;        // slots claimed by writers
+    _Atomic uint32_t lplate_sensor_sequence;        // plates written
+    _Atomic uint32_t lplate_sensor_consumed;        // plates read
+    _Atomic uint32_t lplate_sensor_reader_waiting;  // 1 while the manager sleeps
+    _Atomic uint32_t lplate_sensor_writers_waiting;
+    char license_plate[LPLATE_SENSOR_SLOTS][LICENSE_PLATE_LENGTH];
 } license_plate_sensor_t;
 
 typedef enum boom_gate_state_t
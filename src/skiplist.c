@@ -0,0 +1,262 @@
+#include <stdlib.h>
+#include "skiplist.h"
+
+/**
+ * @brief Allocate a node, for a writer. One of an arena is reused from the
+ * free list for its height if it can be.
+ */
+static skiplist_node_t *skiplist_node_new(skiplist_t *self, uint64_t key, void *value, int height)
+{
+    size_t size = sizeof(skiplist_node_t) + height * sizeof(_Atomic(skiplist_node_t *));
+    skiplist_node_t *node;
+    if(self->arena == NULL)
+    {
+        node = (skiplist_node_t *)malloc(size);
+    }
+    else if((node = self->free[height - 1]) != NULL)
+    {
+        self->free[height - 1] = node->retired;
+    }
+    else
+    {
+        node = (skiplist_node_t *)arena_alloc(self->arena, size);
+    }
+    if(node != NULL)
+    {
+        node->key = key;
+        node->value = value;
+        node->retired = NULL;
+        node->height = height;
+        for(int l = 0; l < height; ++l)
+        {
+            atomic_init(&node->next[l], NULL);
+        }
+    }
+
+    return node;
+}
+
+/**
+ * @brief Height of a new node: each level up with a 1/4 chance (xorshift64).
+ */
+static int skiplist_random_height(skiplist_t *self)
+{
+    self->random ^= self->random << 13;
+    self->random ^= self->random >> 7;
+    self->random ^= self->random << 17;
+
+    int height = 1;
+    for(uint64_t bits = self->random; height < SKIPLIST_MAX_LEVEL && (bits & 3) == 0; bits >>= 2)
+    {
+        ++height;
+    }
+    return height;
+}
+
+/**
+ * @brief Find the last node before key on every level, into preds. Only for writers.
+ */
+static void skiplist_find_preds(skiplist_t *self, uint64_t key, skiplist_node_t *preds[SKIPLIST_MAX_LEVEL])
+{
+    skiplist_node_t *pred = self->head;
+    for(int l = SKIPLIST_MAX_LEVEL - 1; l >= 0; --l)
+    {
+        skiplist_node_t *next;
+        while((next = atomic_load_explicit(&pred->next[l], memory_order_relaxed)) != NULL && next->key < key)
+        {
+            pred = next;
+        }
+        preds[l] = pred;
+    }
+}
+
+/**
+ * @brief Free the deleted nodes once no reader can be on them.
+ */
+static void skiplist_reclaim(skiplist_t *self)
+{
+    if(self->epoch != NULL)
+    {
+        epoch_synchronize(self->epoch);
+    }
+    while(self->retired != NULL)
+    {
+        skiplist_node_t *node = self->retired;
+        self->retired = node->retired;
+        if(self->arena == NULL)
+        {
+            free(node);
+        }
+        else
+        {
+            node->retired = self->free[node->height - 1];
+            self->free[node->height - 1] = node;
+        }
+    }
+    self->num_retired = 0;
+}
+
+uint64_t skiplist_key(const char *key, size_t length)
+{
+    /* Zero past the end, so shorter strings come first: */
+    uint64_t packed = 0;
+    bool ended = false;
+    for(size_t i = 0; i < sizeof(uint64_t); ++i)
+    {
+        ended = ended || i >= length || key[i] == '\0';
+        packed = packed << 8 | (ended ? 0 : (unsigned char)key[i]);
+    }
+    return packed;
+}
+
+bool skiplist_init(skiplist_t *self, epoch_t *epoch)
+{
+    return skiplist_init_arena(self, epoch, NULL);
+}
+
+bool skiplist_init_arena(skiplist_t *self, epoch_t *epoch, arena_t *arena)
+{
+    self->arena = arena;
+    for(int l = 0; l < SKIPLIST_MAX_LEVEL; ++l)
+    {
+        self->free[l] = NULL;
+    }
+    self->head = skiplist_node_new(self, 0, NULL, SKIPLIST_MAX_LEVEL);
+    if(self->head == NULL)
+    {
+        return false;
+    }
+
+    atomic_init(&self->level, 1);
+    self->count = 0;
+    pthread_mutex_init(&self->write_lock, NULL);
+    self->epoch = epoch;
+    self->retired = NULL;
+    self->num_retired = 0;
+    self->random = (uintptr_t)self | 1;
+
+    return true;
+}
+
+void *skiplist_find(skiplist_t *self, uint64_t key)
+{
+    skiplist_node_t *node = skiplist_seek(self, key);
+    return node != NULL && node->key == key ? node->value : NULL;
+}
+
+skiplist_node_t *skiplist_seek(skiplist_t *self, uint64_t key)
+{
+    /* Acquire pairs with the release linking a node in, so it is seen whole: */
+    skiplist_node_t *pred = self->head;
+    skiplist_node_t *next = NULL;
+    for(int l = atomic_load_explicit(&self->level, memory_order_acquire) - 1; l >= 0; --l)
+    {
+        while((next = atomic_load_explicit(&pred->next[l], memory_order_acquire)) != NULL && next->key < key)
+        {
+            pred = next;
+        }
+    }
+
+    return next;
+}
+
+skiplist_node_t *skiplist_next(skiplist_node_t *node)
+{
+    return atomic_load_explicit(&node->next[0], memory_order_acquire);
+}
+
+bool skiplist_insert(skiplist_t *self, uint64_t key, void *value)
+{
+    pthread_mutex_lock(&self->write_lock);
+
+    skiplist_node_t *preds[SKIPLIST_MAX_LEVEL];
+    skiplist_find_preds(self, key, preds);
+    skiplist_node_t *found = atomic_load_explicit(&preds[0]->next[0], memory_order_relaxed);
+    int height = skiplist_random_height(self);
+    skiplist_node_t *node = NULL;
+    if(found == NULL || found->key != key)
+    {
+        node = skiplist_node_new(self, key, value, height);
+    }
+    if(node == NULL)
+    {
+        pthread_mutex_unlock(&self->write_lock);
+        return false;
+    }
+
+    /* Complete the node's own links before any reader can reach it: */
+    for(int l = 0; l < height; ++l)
+    {
+        atomic_store_explicit(&node->next[l], atomic_load_explicit(&preds[l]->next[l], memory_order_relaxed),
+            memory_order_relaxed);
+    }
+    for(int l = 0; l < height; ++l)
+    {
+        atomic_store_explicit(&preds[l]->next[l], node, memory_order_release);
+    }
+    if(height > atomic_load_explicit(&self->level, memory_order_relaxed))
+    {
+        atomic_store_explicit(&self->level, height, memory_order_release);
+    }
+    ++self->count;
+
+    pthread_mutex_unlock(&self->write_lock);
+    return true;
+}
+
+void *skiplist_delete(skiplist_t *self, uint64_t key, const void *value)
+{
+    pthread_mutex_lock(&self->write_lock);
+
+    skiplist_node_t *preds[SKIPLIST_MAX_LEVEL];
+    skiplist_find_preds(self, key, preds);
+    skiplist_node_t *node = atomic_load_explicit(&preds[0]->next[0], memory_order_relaxed);
+    if(node == NULL || node->key != key || (value != NULL && node->value != value))
+    {
+        pthread_mutex_unlock(&self->write_lock);
+        return NULL;
+    }
+
+    /* Top down, the node keeps its own links for readers still on it: */
+    for(int l = node->height - 1; l >= 0; --l)
+    {
+        atomic_store_explicit(&preds[l]->next[l], atomic_load_explicit(&node->next[l], memory_order_relaxed),
+            memory_order_release);
+    }
+    --self->count;
+
+    void *deleted = node->value;
+    node->retired = self->retired;
+    self->retired = node;
+    if(++self->num_retired >= SKIPLIST_RETIRE_BATCH || self->epoch == NULL)
+    {
+        skiplist_reclaim(self);
+    }
+
+    pthread_mutex_unlock(&self->write_lock);
+    return deleted;
+}
+
+void skiplist_destroy(skiplist_t *self)
+{
+    if(self->arena != NULL)
+    {
+        pthread_mutex_destroy(&self->write_lock);
+        return;
+    }
+
+    skiplist_node_t *node = self->head;
+    while(node != NULL)
+    {
+        skiplist_node_t *next = atomic_load_explicit(&node->next[0], memory_order_relaxed);
+        free(node);
+        node = next;
+    }
+    while(self->retired != NULL)
+    {
+        skiplist_node_t *next = self->retired->retired;
+        free(self->retired);
+        self->retired = next;
+    }
+    pthread_mutex_destroy(&self->write_lock);
+}
@@ -0,0 +1,115 @@
+#ifndef  SKIPLIST_H
+#define  SKIPLIST_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include "epoch.h"
+#include "arena.h"
+
+    // Levels of the list, enough for about 4^16 items with a 1/4 chance of each level up
+#define SKIPLIST_MAX_LEVEL 16
+    // Deleted nodes freed together after one wait for readers
+#define SKIPLIST_RETIRE_BATCH 64
+
+typedef struct skiplist_node_t skiplist_node_t;
+
+typedef struct skiplist_node_t
+{
+    uint64_t key;
+    void *value;
+    skiplist_node_t *retired;   // next on the list of deleted nodes waiting to be freed, or of free ones
+    int height;
+    _Atomic(skiplist_node_t *) next[];
+} skiplist_node_t;
+
+/**
+ * @brief An ordered map from keys to values, with lookup, insertion and
+ * deletion in O(log n) and iteration in key order, that can be read by any
+ * number of threads while one thread at a time changes it.
+ *
+ * Reads take no locks and never wait: they follow the links inside a read
+ * section of the list's epoch. Writers are serialised by a mutex and link
+ * a node in from the bottom level up, once it is complete, so a reader
+ * sees it either whole or not at all. A deleted node keeps its links so
+ * readers on it carry on, and is freed once every reader has left it,
+ * SKIPLIST_RETIRE_BATCH at a time.
+ */
+typedef struct skiplist_t
+{
+    skiplist_node_t *head;      // holds no item, linked on every level
+    _Atomic int level;          // levels in use
+    size_t count;
+    pthread_mutex_t write_lock;
+    epoch_t *epoch;
+    skiplist_node_t *retired;
+    size_t num_retired;
+    uint64_t random;            // state of the node height generator
+    arena_t *arena;             // nodes are carved from, NULL if malloc'd
+    skiplist_node_t *free[SKIPLIST_MAX_LEVEL];  // freed nodes of an arena, by height
+} skiplist_t;
+
+/**
+ * @brief Pack up to 8 characters of a string into a key, first character
+ * most significant, so keys are ordered as the strings are.
+ */
+uint64_t skiplist_key(const char *key, size_t length);
+
+/**
+ * @brief Initialise a list whose readers use `epoch`. With a NULL epoch
+ * only the threads changing the list may read it.
+ */
+bool skiplist_init(skiplist_t *self, epoch_t *epoch);
+
+/**
+ * @brief Initialise a list as skiplist_init(), whose nodes are carved from
+ * an arena and reused, by height, once freed, so they are only released with it.
+ */
+bool skiplist_init_arena(skiplist_t *self, epoch_t *epoch, arena_t *arena);
+
+/**
+ * @brief Find the value of a key. Call inside a read section of the list's
+ * epoch, or while no other thread is changing the list.
+ *
+ * @returns The value, or NULL if the key is not in the list.
+ */
+void *skiplist_find(skiplist_t *self, uint64_t key);
+
+/**
+ * @brief Add a key with its value.
+ *
+ * @returns false if the key is already in the list, or out of memory.
+ */
+bool skiplist_insert(skiplist_t *self, uint64_t key, void *value);
+
+/**
+ * @brief Delete a key. May wait for readers to leave deleted nodes.
+ *
+ * @param value If not NULL, only delete the key if this is its value.
+ * @returns Its value, or NULL if the key was not deleted.
+ */
+void *skiplist_delete(skiplist_t *self, uint64_t key, const void *value);
+
+/**
+ * @brief Iterate in key order, from the first node with a key of at least
+ * `key`. Call inside a read section, as skiplist_find(), and stay in it
+ * while using the nodes.
+ *
+ * @returns NULL if there is none.
+ */
+skiplist_node_t *skiplist_seek(skiplist_t *self, uint64_t key);
+
+/**
+ * @brief Node after the given one in key order, NULL at the end.
+ */
+skiplist_node_t *skiplist_next(skiplist_node_t *node);
+
+/**
+ * @brief Destroy a list no thread is reading any more. The nodes of a list
+ * on an arena are left to the arena.
+ */
+void skiplist_destroy(skiplist_t *self);
+
+#endif //SKIPLIST_H
@@ -0,0 +1,211 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include "slab.h"
+
+#define SLAB_ALIGN _Alignof(max_align_t)
+#define ROUND_UP(size) (((size) + SLAB_ALIGN - 1) & ~(SLAB_ALIGN - 1))
+
+/* format of a thread's own free list of a slab. */
+typedef struct slab_cache_t
+{
+    slab_slot_t *free;
+    size_t count;
+    uint64_t generation;    // of the slab the slots belong to
+} slab_cache_t;
+
+/* Bit i is set while a slab has ID i + 1. Generations are never reused, so
+   a cache left behind by a destroyed slab is dropped, not read: */
+static _Atomic uint32_t ids_used = 0;
+static _Atomic uint64_t next_generation = 1;
+static _Thread_local slab_cache_t caches[SLAB_CACHES];
+
+/**
+ * @brief The calling thread's cache of a slab with an ID.
+ */
+static slab_cache_t *slab_cache(slab_t *self)
+{
+    slab_cache_t *cache = &caches[self->id - 1];
+    if(cache->generation != self->generation)
+    {
+        cache->free = NULL;
+        cache->count = 0;
+        cache->generation = self->generation;
+    }
+    return cache;
+}
+
+/*
+ * function add_chunk(): allocate another chunk of slots onto the shared
+ * free list. Called with the mutex held.
+ * output:    false if out of memory.
+ */
+static bool add_chunk(slab_t *self)
+{
+    size_t chunk_size = ROUND_UP(sizeof(slab_chunk_t)) + self->slots_per_chunk * self->slot_size;
+    slab_chunk_t *chunk = (slab_chunk_t *)(self->arena != NULL ? arena_alloc(self->arena, chunk_size)
+        : malloc(chunk_size));
+    if(chunk == NULL)
+    {
+        return false;
+    }
+    chunk->next = self->chunks;
+    self->chunks = chunk;
+
+    /* Thread the slots onto the free list, in address order: */
+    char *slots = (char *)chunk + ROUND_UP(sizeof(slab_chunk_t));
+    for(size_t s = self->slots_per_chunk; s-- > 0;)
+    {
+        slab_slot_t *slot = (slab_slot_t *)(slots + s * self->slot_size);
+        slot->next = self->free;
+        self->free = slot;
+    }
+    return true;
+}
+
+bool slab_init(slab_t *self, size_t object_size, size_t capacity)
+{
+    return slab_init_arena(self, NULL, object_size, capacity);
+}
+
+bool slab_init_arena(slab_t *self, arena_t *arena, size_t object_size, size_t capacity)
+{
+    self->slot_size = ROUND_UP(object_size < sizeof(slab_slot_t) ? sizeof(slab_slot_t) : object_size);
+    self->slots_per_chunk = capacity > 0 ? capacity : 1;
+    self->arena = arena;
+    self->free = NULL;
+    self->chunks = NULL;
+    pthread_mutex_init(&self->mutex, NULL);
+
+    /* Claim the lowest free ID, if any: */
+    self->id = 0;
+    uint32_t used = atomic_load(&ids_used);
+    while(used != UINT32_MAX >> (32 - SLAB_CACHES))
+    {
+        unsigned bit = __builtin_ctz(~used);
+        if(atomic_compare_exchange_weak(&ids_used, &used, used | UINT32_C(1) << bit))
+        {
+            self->id = bit + 1;
+            break;
+        }
+    }
+    self->generation = atomic_fetch_add(&next_generation, 1);
+
+    return add_chunk(self);
+}
+
+void slab_destroy(slab_t *self)
+{
+    while(self->chunks != NULL)
+    {
+        slab_chunk_t *next = self->chunks->next;
+        if(self->arena == NULL)
+        {
+            free(self->chunks);
+        }
+        self->chunks = next;
+    }
+    self->free = NULL;
+    pthread_mutex_destroy(&self->mutex);
+
+    if(self->id != 0)
+    {
+        atomic_fetch_and(&ids_used, ~(UINT32_C(1) << (self->id - 1)));
+    }
+}
+
+size_t slab_object_size(const slab_t *self)
+{
+    return self->slot_size;
+}
+
+/*
+ * function refill(): move up to SLAB_BATCH slots from the shared free list
+ * to the thread's, growing the slab if it is empty.
+ * output:    false if out of memory.
+ */
+static bool refill(slab_t *self, slab_cache_t *cache)
+{
+    pthread_mutex_lock(&self->mutex);
+    if(self->free == NULL && !add_chunk(self))
+    {
+        pthread_mutex_unlock(&self->mutex);
+        return false;
+    }
+
+    slab_slot_t *first = self->free, *last = first;
+    size_t count = 1;
+    while(count < SLAB_BATCH && last->next != NULL)
+    {
+        last = last->next;
+        ++count;
+    }
+    self->free = last->next;
+    pthread_mutex_unlock(&self->mutex);
+
+    last->next = cache->free;
+    cache->free = first;
+    cache->count += count;
+    return true;
+}
+
+void *slab_alloc(slab_t *self)
+{
+    slab_slot_t *slot;
+    if(self->id == 0)
+    {
+        pthread_mutex_lock(&self->mutex);
+        slot = self->free;
+        if(slot != NULL || (add_chunk(self) && (slot = self->free) != NULL))
+        {
+            self->free = slot->next;
+        }
+        pthread_mutex_unlock(&self->mutex);
+        return slot;
+    }
+
+    slab_cache_t *cache = slab_cache(self);
+    if(cache->free == NULL && !refill(self, cache))
+    {
+        return NULL;
+    }
+    slot = cache->free;
+    cache->free = slot->next;
+    --cache->count;
+    return slot;
+}
+
+void slab_free(slab_t *self, void *object)
+{
+    slab_slot_t *slot = (slab_slot_t *)object;
+    if(self->id == 0)
+    {
+        pthread_mutex_lock(&self->mutex);
+        slot->next = self->free;
+        self->free = slot;
+        pthread_mutex_unlock(&self->mutex);
+        return;
+    }
+
+    slab_cache_t *cache = slab_cache(self);
+    slot->next = cache->free;
+    cache->free = slot;
+    if(++cache->count < 2 * SLAB_BATCH)
+    {
+        return;
+    }
+
+    /* A thread that only frees, hand a batch back for the threads that allocate: */
+    slab_slot_t *first = cache->free, *last = first;
+    for(size_t s = 1; s < SLAB_BATCH; ++s)
+    {
+        last = last->next;
+    }
+    cache->free = last->next;
+    cache->count -= SLAB_BATCH;
+
+    pthread_mutex_lock(&self->mutex);
+    last->next = self->free;
+    self->free = first;
+    pthread_mutex_unlock(&self->mutex);
+}
@@ -0,0 +1,85 @@
+#ifndef  SLAB_H
+#define  SLAB_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include "arena.h"
+
+    // Slabs alive at once that get a free list per thread, any more share one
+#define SLAB_CACHES 16
+    // Slots a thread moves to or from the shared free list at a time
+#define SLAB_BATCH 32
+
+typedef struct slab_slot_t slab_slot_t;
+
+/* format of a free slot, the memory of a slot in use is all the owner's. */
+typedef struct slab_slot_t
+{
+    slab_slot_t *next;
+} slab_slot_t;
+
+typedef struct slab_chunk_t slab_chunk_t;
+
+/* format of a block of slots carved out of one allocation. */
+typedef struct slab_chunk_t
+{
+    slab_chunk_t *next;
+} slab_chunk_t;
+
+/**
+ * @brief Pool of equal sized slots, carved out of a few large allocations
+ * and reused through free lists. Each thread allocates from and frees to a
+ * free list of its own, only taking the mutex to move SLAB_BATCH slots to
+ * or from the shared one, so steady churn never calls malloc() and rarely
+ * locks. A slot may be freed by a different thread than allocated it.
+ * Slots cached by a thread that exits stay unused until the slab is destroyed.
+ */
+typedef struct slab_t
+{
+    size_t slot_size;
+    size_t slots_per_chunk;
+    unsigned id;                // 1 to SLAB_CACHES if threads cache slots, else 0
+    uint64_t generation;        // tells this slab's caches from those of an earlier one with its ID
+    arena_t *arena;             // chunks are carved from, NULL if malloc'd
+    pthread_mutex_t mutex;
+    slab_slot_t *free;          // shared free list
+    slab_chunk_t *chunks;
+} slab_t;
+
+/**
+ * @brief Initialise a slab of objects of the given size, with room for
+ * `capacity` of them up front. It grows by as many again when they run out.
+ *
+ * @returns false if out of memory.
+ */
+bool slab_init(slab_t *self, size_t object_size, size_t capacity);
+
+/**
+ * @brief Initialise a slab as slab_init(), whose chunks are carved from an
+ * arena and only released with it.
+ */
+bool slab_init_arena(slab_t *self, arena_t *arena, size_t object_size, size_t capacity);
+
+/**
+ * @brief Free every slot at once, including those still in use. Those of
+ * a slab on an arena are left to the arena.
+ */
+void slab_destroy(slab_t *self);
+
+/**
+ * @brief Size of the objects the slab holds, at least the size it was initialised with.
+ */
+size_t slab_object_size(const slab_t *self);
+
+/**
+ * @brief Allocate an object, aligned as malloc() would.
+ *
+ * @returns NULL if out of memory.
+ */
+void *slab_alloc(slab_t *self);
+
+void slab_free(slab_t *self, void *object);
+
+#endif //SLAB_H
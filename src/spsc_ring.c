@@ -0,0 +1,140 @@
+#include <stdlib.h>
+#include "futex.h"
+#include "spsc_ring.h"
+
+/*
+ * function wake(): wake the other side if it is asleep on its futex word,
+ * after publishing a change it may be waiting on.
+ * algorithm: the fence pairs with the one in sleep_unless(), so either this sees
+ *            the word set or the sleeper sees the change and doesn't sleep.
+ */
+static void wake(_Atomic uint32_t *waiting)
+{
+    atomic_thread_fence(memory_order_seq_cst);
+    if(atomic_load_explicit(waiting, memory_order_relaxed) != 0)
+    {
+        atomic_store_explicit(waiting, 0, memory_order_relaxed);
+        futex_wake(waiting, 1);
+    }
+}
+
+/*
+ * function sleep_unless(): sleep on a futex word unless ready() says the
+ * wait is over once the word is set, so a wake can't be missed.
+ */
+static void sleep_unless(spsc_ring_t *self, _Atomic uint32_t *waiting, bool (*ready)(spsc_ring_t *))
+{
+    atomic_store_explicit(waiting, 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    if(!ready(self))
+    {
+        futex_wait(waiting, 1);
+    }
+    atomic_store_explicit(waiting, 0, memory_order_relaxed);
+}
+
+static bool has_room(spsc_ring_t *self)
+{
+    return atomic_load_explicit(&self->tail, memory_order_relaxed)
+        - atomic_load_explicit(&self->head, memory_order_acquire) <= self->mask;
+}
+
+static bool has_item_or_closed(spsc_ring_t *self)
+{
+    return atomic_load_explicit(&self->tail, memory_order_acquire)
+        != atomic_load_explicit(&self->head, memory_order_relaxed)
+        || atomic_load_explicit(&self->closed, memory_order_acquire);
+}
+
+bool spsc_ring_init(spsc_ring_t *self, uint32_t size)
+{
+    uint32_t capacity = 1;
+    while(capacity < size)
+    {
+        capacity <<= 1;
+    }
+
+    self->slots = (void **)malloc(capacity * sizeof(void *));
+    self->mask = capacity - 1;
+    atomic_init(&self->closed, false);
+    atomic_init(&self->consumer_waiting, 0);
+    atomic_init(&self->producer_waiting, 0);
+    atomic_init(&self->head, 0);
+    self->tail_cache = 0;
+    atomic_init(&self->tail, 0);
+    self->head_cache = 0;
+
+    return self->slots != NULL;
+}
+
+void spsc_ring_destroy(spsc_ring_t *self)
+{
+    free(self->slots);
+    self->slots = NULL;
+}
+
+bool spsc_ring_try_push(spsc_ring_t *self, void *item)
+{
+    uint32_t tail = atomic_load_explicit(&self->tail, memory_order_relaxed);
+    if(tail - self->head_cache > self->mask)
+    {
+        /* Acquire pairs with the consumer's release, so it is done with the slot: */
+        self->head_cache = atomic_load_explicit(&self->head, memory_order_acquire);
+        if(tail - self->head_cache > self->mask)
+        {
+            return false;
+        }
+    }
+
+    self->slots[tail & self->mask] = item;
+    atomic_store_explicit(&self->tail, tail + 1, memory_order_release);
+    wake(&self->consumer_waiting);
+    return true;
+}
+
+void spsc_ring_push(spsc_ring_t *self, void *item)
+{
+    while(!spsc_ring_try_push(self, item))
+    {
+        sleep_unless(self, &self->producer_waiting, has_room);
+    }
+}
+
+void *spsc_ring_try_pop(spsc_ring_t *self)
+{
+    uint32_t head = atomic_load_explicit(&self->head, memory_order_relaxed);
+    if(head == self->tail_cache)
+    {
+        /* Acquire pairs with the producer's release, so the item is written: */
+        self->tail_cache = atomic_load_explicit(&self->tail, memory_order_acquire);
+        if(head == self->tail_cache)
+        {
+            return NULL;
+        }
+    }
+
+    void *item = self->slots[head & self->mask];
+    atomic_store_explicit(&self->head, head + 1, memory_order_release);
+    wake(&self->producer_waiting);
+    return item;
+}
+
+void *spsc_ring_pop(spsc_ring_t *self)
+{
+    void *item;
+    while((item = spsc_ring_try_pop(self)) == NULL)
+    {
+        if(atomic_load_explicit(&self->closed, memory_order_acquire))
+        { /* Items pushed before closing are seen once closed is: */
+            return spsc_ring_try_pop(self);
+        }
+        sleep_unless(self, &self->consumer_waiting, has_item_or_closed);
+    }
+    return item;
+}
+
+void spsc_ring_close(spsc_ring_t *self)
+{
+    atomic_store_explicit(&self->closed, true, memory_order_release);
+    wake(&self->consumer_waiting);
+}
@@ -0,0 +1,74 @@
+#ifndef  SPSC_RING_H
+#define  SPSC_RING_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+#define SPSC_RING_CACHE_LINE 64
+
+/**
+ * @brief Bounded queue of pointers from one producer thread to one
+ * consumer thread. Pushing and popping take no locks: each side owns its
+ * index, on its own cache line, and rereads the other's only when its
+ * cached copy says the ring is full or empty. A side only sleeps, on a
+ * futex, when it must wait for the other, which then wakes it.
+ */
+typedef struct spsc_ring_t
+{
+    /* Read by both, rarely written: */
+    void **slots;
+    uint32_t mask;
+    _Atomic bool closed;
+    _Atomic uint32_t consumer_waiting;  // futex words, 1 while that side sleeps
+    _Atomic uint32_t producer_waiting;
+
+    /* Consumer's: */
+    _Alignas(SPSC_RING_CACHE_LINE) _Atomic uint32_t head;  // next slot to pop
+    uint32_t tail_cache;
+
+    /* Producer's: */
+    _Alignas(SPSC_RING_CACHE_LINE) _Atomic uint32_t tail;  // next slot to push
+    uint32_t head_cache;
+} spsc_ring_t;
+
+/**
+ * @brief Initialise a ring with room for `size` items, rounded up to a power of two.
+ *
+ * @returns false if out of memory.
+ */
+bool spsc_ring_init(spsc_ring_t *self, uint32_t size);
+
+void spsc_ring_destroy(spsc_ring_t *self);
+
+/**
+ * @brief Push an item if there is room, for the producer.
+ */
+bool spsc_ring_try_push(spsc_ring_t *self, void *item);
+
+/**
+ * @brief Push an item, waiting for room, for the producer.
+ */
+void spsc_ring_push(spsc_ring_t *self, void *item);
+
+/**
+ * @brief Pop an item if there is one, for the consumer.
+ *
+ * @returns NULL if the ring is empty.
+ */
+void *spsc_ring_try_pop(spsc_ring_t *self);
+
+/**
+ * @brief Pop an item, waiting for one, for the consumer.
+ *
+ * @returns NULL once the ring is closed and empty.
+ */
+void *spsc_ring_pop(spsc_ring_t *self);
+
+/**
+ * @brief Tell the consumer no more items are coming, for the producer or
+ * once it has stopped. Items already pushed can still be popped.
+ */
+void spsc_ring_close(spsc_ring_t *self);
+
+#endif //SPSC_RING_H
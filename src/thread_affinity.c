@@ -0,0 +1,176 @@
+#include "thread_affinity.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+
+#define THREAD_NAME_LENGTH 16  // including the terminator, the kernel's limit
+
+/* Names of the groups in the file: */
+static const char *group_names[THREAD_GROUP_COUNT] = {
+    [THREAD_GROUP_ENTRANCE_MONITORS] = "entrance_monitors",
+    [THREAD_GROUP_EXIT_MONITORS] = "exit_monitors",
+    [THREAD_GROUP_LEVEL_MONITORS] = "level_monitors",
+    [THREAD_GROUP_MANAGER] = "manager",
+    [THREAD_GROUP_ENTRANCE_QUEUES] = "entrance_queues",
+    [THREAD_GROUP_POOL_WORKERS] = "pool_workers",
+    [THREAD_GROUP_SIMULATOR] = "simulator",
+    [THREAD_GROUP_FIRE_ALARM_MONITORS] = "fire_alarm_monitors",
+};
+
+/* Set once at start up, before the threads that read them are created: */
+static cpu_set_t group_cpus[THREAD_GROUP_COUNT];
+static bool group_pinned[THREAD_GROUP_COUNT];
+
+/*
+ * function parse_cpu_list(): parse a CPU list such as `0-3,6` into a set.
+ * output:    false if it is malformed or names a CPU out of range.
+ */
+static bool parse_cpu_list(const char *list, cpu_set_t *cpus)
+{
+    CPU_ZERO(cpus);
+    const char *p = list;
+    while(*p != '\0')
+    {
+        char *end;
+        long first = strtol(p, &end, 10);
+        long last = first;
+        if(end == p)
+        {
+            return false;
+        }
+        p = end;
+        if(*p == '-')
+        {
+            last = strtol(++p, &end, 10);
+            if(end == p)
+            {
+                return false;
+            }
+            p = end;
+        }
+        if(first < 0 || last < first || last >= CPU_SETSIZE)
+        {
+            return false;
+        }
+        for(long cpu = first; cpu <= last; ++cpu)
+        {
+            CPU_SET(cpu, cpus);
+        }
+
+        if(*p == ',')
+        {
+            ++p;
+        }
+        else if(*p != '\0')
+        {
+            return false;
+        }
+    }
+    return CPU_COUNT(cpus) > 0;
+}
+
+bool thread_affinity_load(const char *path)
+{
+    for(int g = 0; g < THREAD_GROUP_COUNT; ++g)
+    {
+        CPU_ZERO(&group_cpus[g]);
+        group_pinned[g] = false;
+    }
+
+    FILE *file = fopen(path, "r");
+    if(file == NULL)
+    {
+        return true;
+    }
+
+    bool isolate_manager = false;
+    bool ok = true;
+    char line[256];
+    for(int line_num = 1; ok && fgets(line, sizeof(line), file) != NULL; ++line_num)
+    {
+        char key[64], list[192];
+        int fields = sscanf(line, "%63s %191s", key, list);
+        if(fields <= 0 || key[0] == '#')
+        {
+            continue;
+        }
+        if(strcmp(key, "isolate_manager") == 0 && fields == 1)
+        {
+            isolate_manager = true;
+            continue;
+        }
+
+        int g = 0;
+        while(g < THREAD_GROUP_COUNT && strcmp(key, group_names[g]) != 0)
+        {
+            ++g;
+        }
+        ok = g < THREAD_GROUP_COUNT && fields == 2 && parse_cpu_list(list, &group_cpus[g]);
+        if(!ok)
+        {
+            fprintf(stderr, "%s:%d: expected a thread group and a CPU list\n", path, line_num);
+            break;
+        }
+        group_pinned[g] = true;
+    }
+    fclose(file);
+
+    if(ok && isolate_manager)
+    {
+        /* Everything the process may run on, less the manager's CPUs: */
+        cpu_set_t manager_cpus, others, shared;
+        CPU_ZERO(&manager_cpus);
+        for(int g = 0; g < THREAD_GROUP_MANAGER_END; ++g)
+        {
+            CPU_OR(&manager_cpus, &manager_cpus, &group_cpus[g]);
+        }
+        sched_getaffinity(0, sizeof(others), &others);
+        CPU_AND(&shared, &others, &manager_cpus);
+        CPU_XOR(&others, &others, &shared);
+
+        for(int g = THREAD_GROUP_MANAGER_END; g < THREAD_GROUP_COUNT; ++g)
+        {
+            if(group_pinned[g])
+            {
+                CPU_AND(&shared, &group_cpus[g], &manager_cpus);
+                CPU_XOR(&group_cpus[g], &group_cpus[g], &shared);
+            }
+            else
+            {
+                group_cpus[g] = others;
+            }
+            group_pinned[g] = CPU_COUNT(&group_cpus[g]) > 0;
+            if(!group_pinned[g])
+            {
+                fprintf(stderr, "%s: no CPUs left for %s off the manager's\n", path, group_names[g]);
+            }
+        }
+    }
+
+    return ok;
+}
+
+void thread_affinity_pin(thread_group_t group, pthread_t thread)
+{
+    if(group_pinned[group] && pthread_setaffinity_np(thread, sizeof(cpu_set_t), &group_cpus[group]) != 0)
+    {
+        fprintf(stderr, "unable to pin a thread to the %s CPUs\n", group_names[group]);
+    }
+}
+
+void thread_affinity_apply(thread_group_t group, pthread_t thread, const char *name, int index)
+{
+    thread_affinity_pin(group, thread);
+
+    char thread_name[THREAD_NAME_LENGTH];
+    if(index < 0)
+    {
+        snprintf(thread_name, sizeof(thread_name), "%s", name);
+    }
+    else
+    {
+        snprintf(thread_name, sizeof(thread_name), "%s-%d", name, index);
+    }
+    pthread_setname_np(thread, thread_name);
+}
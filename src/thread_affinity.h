@@ -0,0 +1,55 @@
+#ifndef  THREAD_AFFINITY_H
+#define  THREAD_AFFINITY_H
+
+#define _GNU_SOURCE
+#include <stdbool.h>
+#include <pthread.h>
+
+    // CPU sets of the thread groups, read by every program at start up
+#define THREAD_AFFINITY_FILE "affinity.txt"
+
+/**
+ * @brief Groups of threads that can be pinned to a CPU set together. The
+ * first THREAD_GROUP_MANAGER_END are the manager's.
+ */
+typedef enum thread_group_t
+{
+    THREAD_GROUP_ENTRANCE_MONITORS,     // manager, one per entrance
+    THREAD_GROUP_EXIT_MONITORS,         // manager, one per exit
+    THREAD_GROUP_LEVEL_MONITORS,        // manager, one per level
+    THREAD_GROUP_MANAGER,               // manager display, reload and close threads
+    THREAD_GROUP_MANAGER_END,
+    THREAD_GROUP_ENTRANCE_QUEUES = THREAD_GROUP_MANAGER_END, // simulator, one per entrance
+    THREAD_GROUP_POOL_WORKERS,          // simulator car thread pool
+    THREAD_GROUP_SIMULATOR,             // simulator main, car generator and timer threads
+    THREAD_GROUP_FIRE_ALARM_MONITORS,   // fire alarm, one per level
+    THREAD_GROUP_COUNT
+} thread_group_t;
+
+/**
+ * @brief Load the CPU set of each thread group. Each line of the file is a
+ * group name and a CPU list, such as `pool_workers 4-7,10`. Groups left out
+ * are not pinned. A line `isolate_manager` keeps every other group off the
+ * manager's CPUs, so the manager and the simulator sharing a box don't
+ * interfere; groups left out are then pinned to the CPUs the manager doesn't use.
+ * Lines starting with # are comments.
+ *
+ * @returns false if the file is malformed. A missing file pins nothing.
+ */
+bool thread_affinity_load(const char *path);
+
+/**
+ * @brief Pin a thread to its group's CPU set, if it has one, and name it
+ * `name-index` (cut to 15 characters) so the group shows up in profiles.
+ *
+ * @param index Number of the thread in its group, or -1 to name it just `name`.
+ */
+void thread_affinity_apply(thread_group_t group, pthread_t thread, const char *name, int index);
+
+/**
+ * @brief Pin a thread to its group's CPU set without naming it, for a
+ * program's main thread, whose name is the program's.
+ */
+void thread_affinity_pin(thread_group_t group, pthread_t thread);
+
+#endif //THREAD_AFFINITY_H
@@ -1,177 +1,1249 @@
 #include "thread_pool.h"
+#include <limits.h>
+#include "futex.h"
 
 /* format of a single request. */
 typedef struct request_t
 {
     void *(*func)(void *);
     void *args;
+    thread_pool_priority_t priority;
+    thread_pool_group_t *group;     // counted down when it finishes, if not NULL
+#ifdef THREAD_POOL_METRICS
+    uint64_t enqueued_ns;
+#endif
 } request_t;
 
+/* Worker running on this thread, NULL if not a pool thread: */
+static _Thread_local thread_pool_worker_t *current_worker = NULL;
+
 void *handle_requests_loop(void *args);
+void handle_request(request_t *a_request);
+static bool spawn_worker(thread_pool_t *self);
+static void *supervise_loop(void *args);
+
+static uint64_t now_ns(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+/*
+ * function enqueue_ns(): the time to stamp a request queued on a shared ring
+ *                        with. Only the supervisor of an elastic pool and the
+ *                        metrics read it, so otherwise skip the clock.
+ */
+static uint64_t enqueue_ns(const thread_pool_t *self)
+{
+#ifdef THREAD_POOL_METRICS
+    return now_ns();
+#else
+    return self->max_threads > self->min_threads ? now_ns() : 0;
+#endif
+}
 
 void thread_pool_init(thread_pool_t *self)
 {
+    if(!thread_pool_init_sized(self, NUM_HANDLER_THREADS, NUM_HANDLER_THREADS))
+    {
+        fprintf(stderr, "thread_pool_init: out of memory\n");
+        exit(1);
+    }
+}
+
+bool thread_pool_init_sized(thread_pool_t *self, size_t min_threads, size_t max_threads)
+{
+    if(max_threads == 0)
+    {
+        return false;
+    }
+    if(min_threads > max_threads)
+    {
+        min_threads = max_threads;
+    }
+
+    self->workers = (thread_pool_worker_t *)calloc(max_threads, sizeof(thread_pool_worker_t));
+    if(self->workers == NULL)
+    {
+        return false;
+    }
+    self->min_threads = min_threads;
+    self->max_threads = max_threads;
+    atomic_init(&self->num_threads, 0);
+    self->thread_setup = NULL;
+
+    /* Idle workers time out against the monotonic clock: */
+    pthread_condattr_t cond_attr;
+    pthread_condattr_init(&cond_attr);
+    pthread_condattr_setclock(&cond_attr, CLOCK_MONOTONIC);
     pthread_mutex_init(&self->request_mutex, NULL);
-    pthread_cond_init(&self->got_request, NULL);
+    pthread_cond_init(&self->got_request, &cond_attr);
+    pthread_cond_init(&self->not_full, NULL);
+    pthread_cond_init(&self->workers_changed, &cond_attr);
+    pthread_condattr_destroy(&cond_attr);
+
+    for (int p = 0; p < THREAD_POOL_PRIORITIES; p++)
+    {
+        request_ring_t *ring = &self->requests[p];
+        atomic_init(&ring->enqueue_pos, 0);
+        atomic_init(&ring->dequeue_pos, 0);
+        for (size_t i = 0; i < THREAD_POOL_RING_SIZE; i++)
+        {
+            atomic_init(&ring->slots[i].sequence, i);
+            atomic_init(&ring->slots[i].enqueued_ns, 0);
+        }
+    }
+    atomic_init(&self->idle_workers, 0);
+    atomic_init(&self->full_waiters, 0);
+    atomic_init(&self->quit, false);
+
+    for (size_t i = 0; i < max_threads; i++)
+    {
+        atomic_init(&self->workers[i].top, 0);
+        atomic_init(&self->workers[i].bottom, 0);
+        self->workers[i].pool = self;
+        self->workers[i].index = i;
+        self->workers[i].running = false;
+        self->workers[i].turn = 0;
+#ifdef THREAD_POOL_METRICS
+        for (size_t b = 0; b < THREAD_POOL_HIST_BUCKETS; b++)
+        {
+            for (int p = 0; p < THREAD_POOL_PRIORITIES; p++)
+            {
+                atomic_init(&self->workers[i].wait_hist[p].counts[b], 0);
+            }
+            atomic_init(&self->workers[i].run_hist.counts[b], 0);
+        }
+        for (int p = 0; p < THREAD_POOL_PRIORITIES; p++)
+        {
+            atomic_init(&self->workers[i].wait_hist[p].max, 0);
+        }
+        atomic_init(&self->workers[i].run_hist.max, 0);
+        atomic_init(&self->workers[i].busy_ns, 0);
+        atomic_init(&self->workers[i].idle_ns, 0);
+#endif
+    }
 
     /* create the request-handling threads */
-    for (size_t i = 0; i < NUM_HANDLER_THREADS; i++)
+    pthread_mutex_lock(&self->request_mutex);
+    for (size_t i = 0; i < min_threads; i++)
     {
-        // CREATE ALL THE THREADS - Threads to call handle_requests_loop() function
-        pthread_create(&self->p_threads[i], NULL, handle_requests_loop, self);
+        spawn_worker(self);
     }
+    pthread_mutex_unlock(&self->request_mutex);
+
+    if(max_threads > min_threads)
+    {
+        pthread_create(&self->supervisor, NULL, supervise_loop, self);
+    }
+
+    return true;
 }
 
 void thread_pool_close(thread_pool_t *self)
 {
-    /* Signal to all threads to quit: */
-    pthread_mutex_lock(&self->quit_mutex);
-    self->quit = true;
-    pthread_mutex_unlock(&self->quit_mutex);
+    /* Signal to all threads to quit. Set quit and broadcast with the
+       request mutex held: an idle worker checks quit under it before
+       waiting, so setting quit unlocked could land between its check and
+       its wait, leaving it asleep through the broadcast and the join hung: */
+    pthread_mutex_lock(&self->request_mutex);
+    atomic_store(&self->quit, true);
     pthread_cond_broadcast(&self->got_request);
+    pthread_cond_broadcast(&self->not_full);
+    pthread_cond_broadcast(&self->workers_changed);
+
+    /* Workers are detached, wait for the last one to stop: */
+    while(atomic_load(&self->num_threads) > 0)
+    {
+        pthread_cond_wait(&self->workers_changed, &self->request_mutex);
+    }
+    pthread_mutex_unlock(&self->request_mutex);
+
+    if(self->max_threads > self->min_threads)
+    {
+        pthread_join(self->supervisor, NULL);
+    }
+
+    pthread_mutex_destroy(&self->request_mutex);
+    pthread_cond_destroy(&self->got_request);
+    pthread_cond_destroy(&self->not_full);
+    pthread_cond_destroy(&self->workers_changed);
+    free(self->workers);
+    self->workers = NULL;
+}
+
+size_t thread_pool_num_threads(thread_pool_t *self)
+{
+    return atomic_load(&self->num_threads);
+}
+
+void thread_pool_set_thread_setup(thread_pool_t *self, thread_pool_setup_t setup)
+{
+    /* Workers only start and stop with the mutex held, so their threads stay valid: */
+    pthread_mutex_lock(&self->request_mutex);
+    self->thread_setup = setup;
+    for(size_t i = 0; i < self->max_threads; ++i)
+    {
+        if(self->workers[i].running && setup != NULL)
+        {
+            setup(self->workers[i].thread, i);
+        }
+    }
+    pthread_mutex_unlock(&self->request_mutex);
+}
+
+//////////////////// Worker deques:
+
+/*
+ * function deque_push(): push a request onto the bottom of a worker's deque.
+ *                        Only the worker owning the deque may push.
+ * output:    false if the deque is full.
+ */
+static bool deque_push(thread_pool_worker_t *worker, request_t *a_request)
+{
+    int64_t bottom = atomic_load_explicit(&worker->bottom, memory_order_relaxed);
+    int64_t top = atomic_load_explicit(&worker->top, memory_order_acquire);
+    if(bottom - top >= THREAD_POOL_DEQUE_SIZE)
+    {
+        return false;
+    }
+
+    request_slot_t *slot = &worker->slots[bottom & (THREAD_POOL_DEQUE_SIZE - 1)];
+    atomic_store_explicit(&slot->func, a_request->func, memory_order_relaxed);
+    atomic_store_explicit(&slot->args, a_request->args, memory_order_relaxed);
+    atomic_store_explicit(&slot->group, a_request->group, memory_order_relaxed);
+#ifdef THREAD_POOL_METRICS
+    atomic_store_explicit(&slot->enqueued_ns, now_ns(), memory_order_relaxed);
+#endif
+    /* Publish the slot before the new bottom: */
+    atomic_thread_fence(memory_order_release);
+    atomic_store_explicit(&worker->bottom, bottom + 1, memory_order_relaxed);
+    return true;
+}
+
+/*
+ * function deque_push_batch(): push as many of a batch of requests as fit
+ *                              onto the bottom of a worker's deque, with
+ *                              one store of bottom. Only the owner may push.
+ * output:    the number pushed.
+ */
+static size_t deque_push_batch(thread_pool_worker_t *worker, const thread_pool_task_t *tasks, size_t n,
+    thread_pool_group_t *group)
+{
+    int64_t bottom = atomic_load_explicit(&worker->bottom, memory_order_relaxed);
+    int64_t top = atomic_load_explicit(&worker->top, memory_order_acquire);
+    size_t room = THREAD_POOL_DEQUE_SIZE - (size_t)(bottom - top);
+    size_t count = n < room ? n : room;
+    if(count == 0)
+    {
+        return 0;
+    }
+#ifdef THREAD_POOL_METRICS
+    uint64_t enqueued_ns = now_ns();
+#endif
+
+    for(size_t i = 0; i < count; ++i)
+    {
+        request_slot_t *slot = &worker->slots[(bottom + i) & (THREAD_POOL_DEQUE_SIZE - 1)];
+        atomic_store_explicit(&slot->func, tasks[i].func, memory_order_relaxed);
+        atomic_store_explicit(&slot->args, tasks[i].args, memory_order_relaxed);
+        atomic_store_explicit(&slot->group, group, memory_order_relaxed);
+#ifdef THREAD_POOL_METRICS
+        atomic_store_explicit(&slot->enqueued_ns, enqueued_ns, memory_order_relaxed);
+#endif
+    }
+    if(group != NULL)
+    {
+        thread_pool_group_add(group, count);
+    }
+    /* Publish the slots before the new bottom: */
+    atomic_thread_fence(memory_order_release);
+    atomic_store_explicit(&worker->bottom, bottom + count, memory_order_relaxed);
+    return count;
+}
+
+/*
+ * function deque_take(): take the newest request off the bottom of a worker's
+ *                        deque. Only the worker owning the deque may take.
+ * output:    false if the deque is empty, or a thief got the last request.
+ */
+static bool deque_take(thread_pool_worker_t *worker, request_t *a_request)
+{
+    int64_t bottom = atomic_load_explicit(&worker->bottom, memory_order_relaxed) - 1;
+    atomic_store_explicit(&worker->bottom, bottom, memory_order_relaxed);
+    /* Thieves must see the lowered bottom before we read top: */
+    atomic_thread_fence(memory_order_seq_cst);
+    int64_t top = atomic_load_explicit(&worker->top, memory_order_relaxed);
+
+    bool taken = top <= bottom;
+    if(taken)
+    {
+        request_slot_t *slot = &worker->slots[bottom & (THREAD_POOL_DEQUE_SIZE - 1)];
+        a_request->func = atomic_load_explicit(&slot->func, memory_order_relaxed);
+        a_request->args = atomic_load_explicit(&slot->args, memory_order_relaxed);
+        a_request->group = atomic_load_explicit(&slot->group, memory_order_relaxed);
+        a_request->priority = THREAD_POOL_SIMULATION;
+#ifdef THREAD_POOL_METRICS
+        a_request->enqueued_ns = atomic_load_explicit(&slot->enqueued_ns, memory_order_relaxed);
+#endif
+        if(top == bottom)
+        { /* Last request, race any thief for it. */
+            taken = atomic_compare_exchange_strong_explicit(&worker->top, &top, top + 1,
+                memory_order_seq_cst, memory_order_relaxed);
+            atomic_store_explicit(&worker->bottom, bottom + 1, memory_order_relaxed);
+        }
+    }
+    else
+    { /* Was empty, put bottom back. */
+        atomic_store_explicit(&worker->bottom, bottom + 1, memory_order_relaxed);
+    }
 
-    /* Close all threads: */
-    for(size_t i = 0; i < NUM_HANDLER_THREADS; ++i)
+    return taken;
+}
+
+/*
+ * function deque_steal(): steal the oldest request off the top of another
+ *                         worker's deque.
+ * output:    false if the deque is empty, or another thread got the request first.
+ */
+static bool deque_steal(thread_pool_worker_t *worker, request_t *a_request)
+{
+    int64_t top = atomic_load_explicit(&worker->top, memory_order_acquire);
+    atomic_thread_fence(memory_order_seq_cst);
+    int64_t bottom = atomic_load_explicit(&worker->bottom, memory_order_acquire);
+    if(top >= bottom)
     {
-        pthread_join(self->p_threads[i], NULL);
+        return false;
     }
+
+    request_slot_t *slot = &worker->slots[top & (THREAD_POOL_DEQUE_SIZE - 1)];
+    a_request->func = atomic_load_explicit(&slot->func, memory_order_relaxed);
+    a_request->args = atomic_load_explicit(&slot->args, memory_order_relaxed);
+    a_request->group = atomic_load_explicit(&slot->group, memory_order_relaxed);
+    a_request->priority = THREAD_POOL_SIMULATION;
+#ifdef THREAD_POOL_METRICS
+    a_request->enqueued_ns = atomic_load_explicit(&slot->enqueued_ns, memory_order_relaxed);
+#endif
+    return atomic_compare_exchange_strong_explicit(&worker->top, &top, top + 1,
+        memory_order_seq_cst, memory_order_relaxed);
 }
 
+static bool deque_empty(thread_pool_worker_t *worker)
+{
+    return atomic_load(&worker->top) >= atomic_load(&worker->bottom);
+}
+
+//////////////////// End worker deques.
+
+//////////////////// Shared ring:
+
 /*
- * function add_request(): add a request to the requests list
- * algorithm: creates a request structure, adds to the list, and
- *            increases number of pending requests by one.
- * input:     request number, linked list mutex.
+ * function ring_push(): add a request to the end of the shared ring,
+ *                       stamped with enqueued_ns.
+ * output:    false if the ring is full.
+ */
+static bool ring_push(request_ring_t *ring, request_t *a_request, uint64_t enqueued_ns)
+{
+    size_t pos = atomic_load_explicit(&ring->enqueue_pos, memory_order_relaxed);
+    ring_slot_t *slot;
+    while(true)
+    {
+        slot = &ring->slots[pos & (THREAD_POOL_RING_SIZE - 1)];
+        size_t sequence = atomic_load_explicit(&slot->sequence, memory_order_acquire);
+        intptr_t turn = (intptr_t)sequence - (intptr_t)pos;
+        if(turn == 0)
+        { /* Free slot, claim it (updates pos if another submitter got there first). */
+            if(atomic_compare_exchange_weak(&ring->enqueue_pos, &pos, pos + 1))
+            {
+                break;
+            }
+        }
+        else if(turn < 0)
+        { /* Still holds the request from a lap ago. */
+            return false;
+        }
+        else
+        {
+            pos = atomic_load_explicit(&ring->enqueue_pos, memory_order_relaxed);
+        }
+    }
+
+    slot->func = a_request->func;
+    slot->args = a_request->args;
+    slot->group = a_request->group;
+    atomic_store_explicit(&slot->enqueued_ns, enqueued_ns, memory_order_relaxed);
+    /* Hand the slot to the worker that takes this position: */
+    atomic_store_explicit(&slot->sequence, pos + 1, memory_order_release);
+    return true;
+}
+
+/*
+ * function ring_push_batch(): add as many of a batch of requests as fit to
+ *                             the end of the shared ring, claiming all their
+ *                             positions with one compare-and-swap.
+ * output:    the number added.
+ */
+static size_t ring_push_batch(request_ring_t *ring, const thread_pool_task_t *tasks, size_t n,
+    thread_pool_group_t *group, uint64_t enqueued_ns)
+{
+    if(n > THREAD_POOL_RING_SIZE)
+    {
+        n = THREAD_POOL_RING_SIZE;
+    }
+
+    size_t pos = atomic_load_explicit(&ring->enqueue_pos, memory_order_relaxed);
+    size_t count;
+    while(true)
+    {
+        /* Count the free slots from pos. Free slots stay free until claimed,
+           so they are still free if the claim succeeds: */
+        count = 0;
+        intptr_t turn = 0;
+        while(count < n)
+        {
+            ring_slot_t *slot = &ring->slots[(pos + count) & (THREAD_POOL_RING_SIZE - 1)];
+            size_t sequence = atomic_load_explicit(&slot->sequence, memory_order_acquire);
+            turn = (intptr_t)sequence - (intptr_t)(pos + count);
+            if(turn != 0)
+            {
+                break;
+            }
+            ++count;
+        }
+
+        if(count > 0)
+        {
+            if(atomic_compare_exchange_weak(&ring->enqueue_pos, &pos, pos + count))
+            {
+                break;
+            }
+        }
+        else if(turn < 0)
+        { /* Full. */
+            return 0;
+        }
+        else
+        {
+            pos = atomic_load_explicit(&ring->enqueue_pos, memory_order_relaxed);
+        }
+    }
+
+    if(group != NULL)
+    {
+        thread_pool_group_add(group, count);
+    }
+    for(size_t i = 0; i < count; ++i)
+    {
+        ring_slot_t *slot = &ring->slots[(pos + i) & (THREAD_POOL_RING_SIZE - 1)];
+        slot->func = tasks[i].func;
+        slot->args = tasks[i].args;
+        slot->group = group;
+        atomic_store_explicit(&slot->enqueued_ns, enqueued_ns, memory_order_relaxed);
+        atomic_store_explicit(&slot->sequence, pos + i + 1, memory_order_release);
+    }
+    return count;
+}
+
+/*
+ * function ring_pop(): take the request at the front of the shared ring.
+ * output:    false if the ring is empty.
+ */
+static bool ring_pop(request_ring_t *ring, request_t *a_request)
+{
+    size_t pos = atomic_load_explicit(&ring->dequeue_pos, memory_order_relaxed);
+    ring_slot_t *slot;
+    while(true)
+    {
+        slot = &ring->slots[pos & (THREAD_POOL_RING_SIZE - 1)];
+        size_t sequence = atomic_load_explicit(&slot->sequence, memory_order_acquire);
+        intptr_t turn = (intptr_t)sequence - (intptr_t)(pos + 1);
+        if(turn == 0)
+        {
+            if(atomic_compare_exchange_weak(&ring->dequeue_pos, &pos, pos + 1))
+            {
+                break;
+            }
+        }
+        else if(turn < 0)
+        { /* Not filled yet. */
+            return false;
+        }
+        else
+        {
+            pos = atomic_load_explicit(&ring->dequeue_pos, memory_order_relaxed);
+        }
+    }
+
+    a_request->func = slot->func;
+    a_request->args = slot->args;
+    a_request->group = slot->group;
+#ifdef THREAD_POOL_METRICS
+    a_request->enqueued_ns = atomic_load_explicit(&slot->enqueued_ns, memory_order_relaxed);
+#endif
+    /* Hand the slot back to the submitter one lap on: */
+    atomic_store_explicit(&slot->sequence, pos + THREAD_POOL_RING_SIZE, memory_order_release);
+    return true;
+}
+
+static bool ring_empty(request_ring_t *ring)
+{
+    return atomic_load(&ring->dequeue_pos) >= atomic_load(&ring->enqueue_pos);
+}
+
+/*
+ * function ring_backlog(): check if the shared ring has more than
+ *                          THREAD_POOL_SPAWN_DEPTH requests waiting, or its
+ *                          oldest request has waited too long. Approximate,
+ *                          as other threads keep changing the ring.
+ */
+static bool ring_backlog(request_ring_t *ring)
+{
+    size_t dequeue_pos = atomic_load(&ring->dequeue_pos);
+    size_t enqueue_pos = atomic_load(&ring->enqueue_pos);
+    if(enqueue_pos <= dequeue_pos)
+    {
+        return false;
+    }
+    if(enqueue_pos - dequeue_pos > THREAD_POOL_SPAWN_DEPTH)
+    {
+        return true;
+    }
+
+    ring_slot_t *oldest = &ring->slots[dequeue_pos & (THREAD_POOL_RING_SIZE - 1)];
+    uint64_t enqueued_ns = atomic_load_explicit(&oldest->enqueued_ns, memory_order_relaxed);
+    return atomic_load_explicit(&oldest->sequence, memory_order_acquire) == dequeue_pos + 1
+        && now_ns() - enqueued_ns > (uint64_t)THREAD_POOL_SPAWN_WAIT_MS * 1000000;
+}
+
+/*
+ * function backlog(): check if requests are backing up: an emergency
+ *                     request waiting at all, or a backlog on another ring.
+ */
+static bool backlog(thread_pool_t *self)
+{
+    return !ring_empty(&self->requests[THREAD_POOL_EMERGENCY])
+        || ring_backlog(&self->requests[THREAD_POOL_CONTROL])
+        || ring_backlog(&self->requests[THREAD_POOL_SIMULATION]);
+}
+
+//////////////////// End shared ring.
+
+//////////////////// Pool sizing:
+
+/*
+ * function spawn_worker(): start a thread for a worker that isn't running.
+ *                          Call with the request mutex held.
+ * output:    false if the pool is at its maximum size or closing.
+ */
+static bool spawn_worker(thread_pool_t *self)
+{
+    if(atomic_load(&self->quit) || atomic_load(&self->num_threads) >= self->max_threads)
+    {
+        return false;
+    }
+
+    for(size_t i = 0; i < self->max_threads; ++i)
+    {
+        thread_pool_worker_t *worker = &self->workers[i];
+        if(!worker->running)
+        {
+            /* Its deque was left empty when it stopped, so nothing to reset. */
+            pthread_attr_t attr;
+            pthread_attr_init(&attr);
+            pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+            worker->running = pthread_create(&worker->thread, &attr, handle_requests_loop, worker) == 0;
+            pthread_attr_destroy(&attr);
+
+            if(worker->running)
+            {
+                atomic_fetch_add(&self->num_threads, 1);
+                if(self->thread_setup != NULL)
+                {
+                    self->thread_setup(worker->thread, i);
+                }
+            }
+            return worker->running;
+        }
+    }
+
+    return false;
+}
+
+/*
+ * function grow(): spawn a worker if requests are backing up with none idle.
+ *                  Call without the request mutex held.
+ */
+static void grow(thread_pool_t *self)
+{
+    /* Cheap checks first, this runs on every submission: */
+    if(self->max_threads == self->min_threads || atomic_load(&self->idle_workers) > 0
+        || atomic_load(&self->num_threads) >= self->max_threads || !backlog(self))
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&self->request_mutex);
+    if(atomic_load(&self->idle_workers) == 0)
+    {
+        spawn_worker(self);
+    }
+    pthread_mutex_unlock(&self->request_mutex);
+}
+
+/*
+ * function supervise_loop(): for an elastic pool, check for backed up
+ *                            requests every THREAD_POOL_SPAWN_WAIT_MS. Catches
+ *                            requests stuck behind workers that are all
+ *                            busy for a long time, with no more submissions
+ *                            coming to notice them.
+ * input:     the pool.
  * output:    none.
  */
-void thread_pool_add_request(thread_pool_t *self, void *(*func)(void *), void *args)
+static void *supervise_loop(void *args)
 {
-    request_t *a_request; /* pointer to newly added request.     */
+    thread_pool_t *self = (thread_pool_t *)args;
 
-    /* create structure with new request */
-    a_request = (request_t *)malloc(sizeof(request_t));
-    if (!a_request)
-    { /* malloc failed?? */
-        fprintf(stderr, "add_request: out of memory\n");
-        exit(1);
+    pthread_mutex_lock(&self->request_mutex);
+    while(!atomic_load(&self->quit))
+    {
+        struct timespec wake;
+        clock_gettime(CLOCK_MONOTONIC, &wake);
+        wake.tv_nsec += THREAD_POOL_SPAWN_WAIT_MS * 1000000L;
+        wake.tv_sec += wake.tv_nsec / 1000000000L;
+        wake.tv_nsec %= 1000000000L;
+        pthread_cond_timedwait(&self->workers_changed, &self->request_mutex, &wake);
+
+        if(atomic_load(&self->idle_workers) == 0 && backlog(self))
+        {
+            spawn_worker(self);
+        }
     }
-    a_request->func = func;
-    a_request->args = args;
+    pthread_mutex_unlock(&self->request_mutex);
 
-    /* lock the mutex, to assure exclusive access to the list */
-    if(&self->request_mutex != NULL)
+    return NULL;
+}
+
+//////////////////// End pool sizing.
+
+/*
+ * function wake_worker(): wake a sleeping worker, if there is one, to
+ *                         handle a request that was just added.
+ */
+static void wake_worker(thread_pool_t *self)
+{
+    /* Order the request before reading the idle count. Pairs with a worker
+       counting itself idle, then checking for requests: */
+    atomic_thread_fence(memory_order_seq_cst);
+    if(atomic_load(&self->idle_workers) > 0)
     {
         pthread_mutex_lock(&self->request_mutex);
+        pthread_cond_signal(&self->got_request);
+        pthread_mutex_unlock(&self->request_mutex);
+    }
+}
+
+/*
+ * function wake_workers(): wake sleeping workers, if there are any, for
+ *                          count requests that were just added.
+ */
+static void wake_workers(thread_pool_t *self, size_t count)
+{
+    atomic_thread_fence(memory_order_seq_cst);
+    if(atomic_load(&self->idle_workers) > 0)
+    {
+        pthread_mutex_lock(&self->request_mutex);
+        if(count > 1)
+        {
+            pthread_cond_broadcast(&self->got_request);
+        }
+        else
+        {
+            pthread_cond_signal(&self->got_request);
+        }
+        pthread_mutex_unlock(&self->request_mutex);
+    }
+}
+
+/*
+ * function queue_request(): queue a request without waiting. A simulation
+ *                           request on a worker of this pool goes onto its
+ *                           own deque, anything else (or if that is full)
+ *                           onto the shared ring of its priority, so urgent
+ *                           requests are never stuck behind a deque.
+ * output:    false if the queue was full.
+ */
+static bool queue_request(thread_pool_t *self, request_t *a_request)
+{
+    thread_pool_worker_t *worker = current_worker;
+    bool on_worker = worker != NULL && worker->pool == self;
+    return (on_worker && a_request->priority == THREAD_POOL_SIMULATION && deque_push(worker, a_request))
+        || ring_push(&self->requests[a_request->priority], a_request, enqueue_ns(self));
+}
+
+/*
+ * function queue_batch(): queue as many of a batch of requests as fit
+ *                         without waiting, where queue_request() would.
+ * output:    the number queued.
+ */
+static size_t queue_batch(thread_pool_t *self, thread_pool_priority_t priority,
+    const thread_pool_task_t *tasks, size_t n, thread_pool_group_t *group)
+{
+    thread_pool_worker_t *worker = current_worker;
+    size_t count = 0;
+    if(worker != NULL && worker->pool == self && priority == THREAD_POOL_SIMULATION)
+    {
+        count = deque_push_batch(worker, tasks, n, group);
+    }
+    if(count < n)
+    {
+        count += ring_push_batch(&self->requests[priority], &tasks[count], n - count, group, enqueue_ns(self));
+    }
+    return count;
+}
+
+bool thread_pool_try_add_request(thread_pool_t *self, void *(*func)(void *), void *args)
+{
+    return thread_pool_try_add_request_priority(self, THREAD_POOL_SIMULATION, func, args);
+}
+
+bool thread_pool_try_add_request_priority(thread_pool_t *self, thread_pool_priority_t priority,
+    void *(*func)(void *), void *args)
+{
+    request_t a_request = { func, args, priority };
+    if(!queue_request(self, &a_request))
+    {
+        return false;
     }
 
-    /* add new request to the end of the list, updating list */
-    llist_append(&self->request_list, a_request, sizeof(request_t));
+    wake_worker(self);
+    grow(self);
+    return true;
+}
 
-    /* increase total number of pending requests by one. */
-    self->num_requests++;
+/*
+ * function add_request(): add a request to the pool
+ * algorithm: queue the request. If the ring is full, a worker of this pool
+ *            runs it itself; any other thread counts itself waiting and
+ *            sleeps until a worker takes a request from the ring.
+ * input:     request priority, function and its argument.
+ * output:    none.
+ */
+void thread_pool_add_request_priority(thread_pool_t *self, thread_pool_priority_t priority,
+    void *(*func)(void *), void *args)
+{
+    request_t a_request = { func, args, priority };
 
-    /* unlock mutex */
-    if(&self->request_mutex != NULL)
+    while(!queue_request(self, &a_request))
     {
+        if(current_worker != NULL && current_worker->pool == self)
+        { /* Every worker could end up waiting here, run it now. */
+            handle_request(&a_request);
+            return;
+        }
+
+        /* Count ourselves waiting before the last try, so a worker
+           emptying a slot after it is sure to see us and signal: */
+        pthread_mutex_lock(&self->request_mutex);
+        atomic_fetch_add(&self->full_waiters, 1);
+        bool queued = queue_request(self, &a_request);
+        if(!queued && !atomic_load(&self->quit))
+        {
+            /* Full ring, more workers would help if we may have them: */
+            if(atomic_load(&self->idle_workers) == 0)
+            {
+                spawn_worker(self);
+            }
+            pthread_cond_wait(&self->not_full, &self->request_mutex);
+        }
+        atomic_fetch_sub(&self->full_waiters, 1);
         pthread_mutex_unlock(&self->request_mutex);
+
+        if(queued)
+        {
+            break;
+        }
+        if(atomic_load(&self->quit))
+        {
+            return;
+        }
     }
 
-    /* signal the condition variable - there's a new request to handle */
-    if(&self->request_mutex != NULL)
+    wake_worker(self);
+    grow(self);
+}
+
+void thread_pool_add_request(thread_pool_t *self, void *(*func)(void *), void *args)
+{
+    thread_pool_add_request_priority(self, THREAD_POOL_SIMULATION, func, args);
+}
+
+/*
+ * function add_batch(): add a batch of requests to the pool
+ * algorithm: queue as many as fit at once and wake the workers for them,
+ *            until all are queued. When none fit, wait for room as
+ *            add_request() does, a worker of this pool running one itself.
+ * input:     request priority, the requests and a group to count them in.
+ * output:    none.
+ */
+void thread_pool_add_batch(thread_pool_t *self, thread_pool_priority_t priority,
+    const thread_pool_task_t *tasks, size_t n, thread_pool_group_t *group)
+{
+    size_t done = 0;
+    while(done < n)
     {
-        pthread_cond_signal(&self->got_request);
+        size_t queued = queue_batch(self, priority, &tasks[done], n - done, group);
+        if(queued == 0 && current_worker != NULL && current_worker->pool == self)
+        { /* Every worker could end up waiting here, run one now. */
+            request_t a_request = { tasks[done].func, tasks[done].args, priority, group };
+            if(group != NULL)
+            {
+                thread_pool_group_add(group, 1);
+            }
+            handle_request(&a_request);
+            ++done;
+            continue;
+        }
+        if(queued == 0)
+        {
+            /* Count ourselves waiting before the last try, as in add_request(): */
+            pthread_mutex_lock(&self->request_mutex);
+            atomic_fetch_add(&self->full_waiters, 1);
+            queued = queue_batch(self, priority, &tasks[done], n - done, group);
+            if(queued == 0 && !atomic_load(&self->quit))
+            {
+                if(atomic_load(&self->idle_workers) == 0)
+                {
+                    spawn_worker(self);
+                }
+                pthread_cond_wait(&self->not_full, &self->request_mutex);
+            }
+            atomic_fetch_sub(&self->full_waiters, 1);
+            pthread_mutex_unlock(&self->request_mutex);
+
+            if(queued == 0 && atomic_load(&self->quit))
+            {
+                return;
+            }
+        }
+
+        if(queued > 0)
+        {
+            done += queued;
+            wake_workers(self, queued);
+            grow(self);
+        }
+    }
+}
+
+/*
+ * function get_request(): gets the first pending request from the shared
+ *                         ring of a priority, then wakes the submitters
+ *                         waiting for room (they may be waiting on any ring).
+ * output:    false if the ring was empty.
+ */
+static bool get_request(thread_pool_t *self, thread_pool_priority_t priority, request_t *a_request)
+{
+    if(!ring_pop(&self->requests[priority], a_request))
+    {
+        return false;
+    }
+    a_request->priority = priority;
+
+    /* Order the freed slot before reading the waiter count: */
+    atomic_thread_fence(memory_order_seq_cst);
+    if(atomic_load(&self->full_waiters) > 0)
+    {
+        pthread_mutex_lock(&self->request_mutex);
+        pthread_cond_broadcast(&self->not_full);
+        pthread_mutex_unlock(&self->request_mutex);
+    }
+    return true;
+}
+
+/*
+ * function take_simulation(): take a simulation request, from the worker's
+ *                             own deque (newest first, still in cache),
+ *                             then the shared ring.
+ */
+static bool take_simulation(thread_pool_worker_t *worker, request_t *a_request)
+{
+    return deque_take(worker, a_request) || get_request(worker->pool, THREAD_POOL_SIMULATION, a_request);
+}
+
+/*
+ * function find_request(): find a request for a worker to handle.
+ * algorithm: emergency requests first. Then control requests, or
+ *            simulation requests every THREAD_POOL_CONTROL_WEIGHT + 1
+ *            turns, falling back to the other if there are none. Then
+ *            steal the oldest request of the other workers in turn,
+ *            starting with the next one along.
+ * output:    false if there was nothing to do.
+ */
+static bool find_request(thread_pool_worker_t *worker, request_t *a_request)
+{
+    thread_pool_t *self = worker->pool;
+
+    if(get_request(self, THREAD_POOL_EMERGENCY, a_request))
+    {
+        return true;
+    }
+
+    bool found;
+    if(worker->turn % (THREAD_POOL_CONTROL_WEIGHT + 1) < THREAD_POOL_CONTROL_WEIGHT)
+    {
+        found = get_request(self, THREAD_POOL_CONTROL, a_request) || take_simulation(worker, a_request);
+    }
+    else
+    {
+        found = take_simulation(worker, a_request) || get_request(self, THREAD_POOL_CONTROL, a_request);
+    }
+    if(found)
+    {
+        ++worker->turn;
+        return true;
+    }
+
+    /* Stopped workers' deques are empty, not worth skipping: */
+    for(size_t i = 1; i < self->max_threads; ++i)
+    {
+        if(deque_steal(&self->workers[(worker->index + i) % self->max_threads], a_request))
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/*
+ * function has_request(): check if any request is waiting anywhere in the pool.
+ */
+static bool has_request(thread_pool_t *self)
+{
+    for(int p = 0; p < THREAD_POOL_PRIORITIES; ++p)
+    {
+        if(!ring_empty(&self->requests[p]))
+        {
+            return true;
+        }
+    }
+    for(size_t i = 0; i < self->max_threads; ++i)
+    {
+        if(!deque_empty(&self->workers[i]))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+//////////////////// Task groups:
+
+/* Top bit of a group's count, set by a waiter before it sleeps: */
+#define GROUP_WAITING (UINT32_C(1) << 31)
+
+void thread_pool_group_init(thread_pool_group_t *group)
+{
+    atomic_init(&group->pending, 0);
+}
+
+void thread_pool_group_add(thread_pool_group_t *group, size_t n)
+{
+    atomic_fetch_add_explicit(&group->pending, (uint32_t)n, memory_order_relaxed);
+}
+
+void thread_pool_group_done(thread_pool_group_t *group)
+{
+    /* The decrement is the last touch of the group's memory, the wake only
+       uses its address, so a waiter may free it as soon as it sees zero: */
+    uint32_t previous = atomic_fetch_sub_explicit(&group->pending, 1, memory_order_acq_rel);
+    if(previous == (GROUP_WAITING | 1))
+    {
+        futex_wake(&group->pending, INT_MAX);
     }
 }
 
+void thread_pool_group_wait(thread_pool_group_t *group)
+{
+    uint32_t pending = atomic_load_explicit(&group->pending, memory_order_acquire);
+    while((pending & ~GROUP_WAITING) != 0)
+    {
+        /* Mark it waited on first, so the last done wakes us: */
+        if((pending & GROUP_WAITING) == 0
+            && !atomic_compare_exchange_weak(&group->pending, &pending, pending | GROUP_WAITING))
+        {
+            continue;
+        }
+        futex_wait(&group->pending, pending | GROUP_WAITING);
+        pending = atomic_load_explicit(&group->pending, memory_order_acquire);
+    }
+}
+
+//////////////////// End task groups.
+
+//////////////////// Metrics:
+
+#ifdef THREAD_POOL_METRICS
+#define HIST_SUB_BUCKETS (1 << THREAD_POOL_HIST_SUB_BITS)
+
 /*
- * function get_request(): gets the first pending request from the requests list
- *                         removing it from the list.
- * algorithm: creates a request structure, adds to the list, and
- *            increases number of pending requests by one.
- * output:    pointer to the removed request, or NULL if none.
- * memory:    the returned request need to be freed by the caller.
+ * function histogram_bucket(): bucket of a duration. Values under
+ *                              2 * HIST_SUB_BUCKETS have a bucket each, above
+ *                              that each power of two is split HIST_SUB_BUCKETS ways.
  */
-request_t *get_request(thread_pool_t *self)
+static size_t histogram_bucket(uint64_t ns)
 {
-    node_t *request_node = llist_pop(&self->request_list);
-    request_t *a_request = NULL;
-    if(request_node != NULL)
-    { /* Not an empty list. */
-        a_request = (request_t *)request_node->data;
-        --self->num_requests;
+    if(ns < HIST_SUB_BUCKETS)
+    {
+        return ns;
     }
+    unsigned exponent = 63 - __builtin_clzll(ns);
+    if(exponent >= THREAD_POOL_HIST_MAX_BITS)
+    {
+        return THREAD_POOL_HIST_BUCKETS - 1;
+    }
+    unsigned shift = exponent - THREAD_POOL_HIST_SUB_BITS;
+    return ((size_t)(shift + 1) << THREAD_POOL_HIST_SUB_BITS) + ((ns >> shift) & (HIST_SUB_BUCKETS - 1));
+}
 
-    return a_request;
+/*
+ * function histogram_bucket_top(): largest duration that falls in a bucket.
+ */
+static uint64_t histogram_bucket_top(size_t bucket)
+{
+    if(bucket < 2 * HIST_SUB_BUCKETS)
+    {
+        return bucket;
+    }
+    unsigned shift = (bucket >> THREAD_POOL_HIST_SUB_BITS) - 1;
+    uint64_t sub = HIST_SUB_BUCKETS + (bucket & (HIST_SUB_BUCKETS - 1));
+    return ((sub + 1) << shift) - 1;
 }
 
+/*
+ * function histogram_record(): count a duration. Only the worker owning the
+ *                              histogram may record into it.
+ */
+static void histogram_record(thread_pool_histogram_t *hist, uint64_t ns)
+{
+    _Atomic uint64_t *count = &hist->counts[histogram_bucket(ns)];
+    atomic_store_explicit(count, atomic_load_explicit(count, memory_order_relaxed) + 1, memory_order_relaxed);
+    if(ns > atomic_load_explicit(&hist->max, memory_order_relaxed))
+    {
+        atomic_store_explicit(&hist->max, ns, memory_order_relaxed);
+    }
+}
+
+static void add_relaxed(_Atomic uint64_t *counter, uint64_t n)
+{
+    atomic_store_explicit(counter, atomic_load_explicit(counter, memory_order_relaxed) + n, memory_order_relaxed);
+}
+
+/*
+ * function histogram_percentiles(): percentiles of a histogram's counts,
+ *                                   summed over every worker.
+ * output:    the number of durations counted.
+ */
+static uint64_t histogram_percentiles(const uint64_t *counts, uint64_t max, thread_pool_percentiles_t *out)
+{
+    uint64_t total = 0;
+    for(size_t b = 0; b < THREAD_POOL_HIST_BUCKETS; ++b)
+    {
+        total += counts[b];
+    }
+
+    const double quantiles[] = { 0.5, 0.9, 0.99, 0.999 };
+    uint64_t *results[] = { &out->p50, &out->p90, &out->p99, &out->p999 };
+    size_t b = 0;
+    uint64_t seen = 0;
+    for(size_t q = 0; q < sizeof(quantiles) / sizeof(quantiles[0]); ++q)
+    {
+        /* Rank of the percentile, from 1: */
+        double exact = quantiles[q] * total;
+        uint64_t rank = (uint64_t)exact;
+        if(rank < exact || rank == 0)
+        {
+            ++rank;
+        }
+        while(b < THREAD_POOL_HIST_BUCKETS && seen + counts[b] < rank)
+        {
+            seen += counts[b++];
+        }
+        uint64_t top = total == 0 ? 0 : histogram_bucket_top(b);
+        *results[q] = top < max ? top : max;
+    }
+    out->max = max;
+    return total;
+}
+#endif
+
+bool thread_pool_metrics(thread_pool_t *self, thread_pool_metrics_t *metrics)
+{
+#ifdef THREAD_POOL_METRICS
+    uint64_t wait_counts[THREAD_POOL_PRIORITIES + 1][THREAD_POOL_HIST_BUCKETS] = { { 0 } }; // last for all
+    uint64_t run_counts[THREAD_POOL_HIST_BUCKETS] = { 0 };
+    uint64_t wait_max[THREAD_POOL_PRIORITIES + 1] = { 0 }, run_max = 0;
+    metrics->busy_ns = 0;
+    metrics->idle_ns = 0;
+
+    for(size_t i = 0; i < self->max_threads; ++i)
+    {
+        thread_pool_worker_t *worker = &self->workers[i];
+        for(int p = 0; p < THREAD_POOL_PRIORITIES; ++p)
+        {
+            for(size_t b = 0; b < THREAD_POOL_HIST_BUCKETS; ++b)
+            {
+                uint64_t count = atomic_load_explicit(&worker->wait_hist[p].counts[b], memory_order_relaxed);
+                wait_counts[p][b] += count;
+                wait_counts[THREAD_POOL_PRIORITIES][b] += count;
+            }
+            uint64_t max = atomic_load_explicit(&worker->wait_hist[p].max, memory_order_relaxed);
+            wait_max[p] = max > wait_max[p] ? max : wait_max[p];
+        }
+        for(size_t b = 0; b < THREAD_POOL_HIST_BUCKETS; ++b)
+        {
+            run_counts[b] += atomic_load_explicit(&worker->run_hist.counts[b], memory_order_relaxed);
+        }
+        uint64_t max = atomic_load_explicit(&worker->run_hist.max, memory_order_relaxed);
+        run_max = max > run_max ? max : run_max;
+        metrics->busy_ns += atomic_load_explicit(&worker->busy_ns, memory_order_relaxed);
+        metrics->idle_ns += atomic_load_explicit(&worker->idle_ns, memory_order_relaxed);
+    }
+
+    for(int p = 0; p < THREAD_POOL_PRIORITIES; ++p)
+    {
+        metrics->requests_by_priority[p] = histogram_percentiles(wait_counts[p], wait_max[p], &metrics->wait_by_priority[p]);
+        wait_max[THREAD_POOL_PRIORITIES] = wait_max[p] > wait_max[THREAD_POOL_PRIORITIES]
+            ? wait_max[p] : wait_max[THREAD_POOL_PRIORITIES];
+    }
+    histogram_percentiles(wait_counts[THREAD_POOL_PRIORITIES], wait_max[THREAD_POOL_PRIORITIES], &metrics->wait);
+    metrics->requests = histogram_percentiles(run_counts, run_max, &metrics->run);
+    uint64_t total_ns = metrics->busy_ns + metrics->idle_ns;
+    metrics->utilisation = total_ns == 0 ? 0.0 : (double)metrics->busy_ns / total_ns;
+    return true;
+#else
+    (void)self;
+    (void)metrics;
+    return false;
+#endif
+}
+
+//////////////////// End metrics.
+
 /*
  * function handle_request(): handle a single given request.
- * algorithm: prints a message stating that the given thread handled
- *            the given request.
- * input:     request pointer, id of calling thread.
+ * input:     request pointer.
  * output:    none.
  */
 void handle_request(request_t *a_request)
 {
     a_request->func(a_request->args);
+    if(a_request->group != NULL)
+    {
+        thread_pool_group_done(a_request->group);
+    }
+}
+
+/*
+ * function stop_worker(): mark the worker stopped and tell whoever is
+ *                         waiting on the pool size. Call with the request
+ *                         mutex held, just before the worker's thread returns.
+ */
+static void stop_worker(thread_pool_worker_t *worker)
+{
+    thread_pool_t *self = worker->pool;
+    worker->running = false;
+    atomic_fetch_sub(&self->num_threads, 1);
+    pthread_cond_broadcast(&self->workers_changed);
 }
 
 /*
  * function handle_requests_loop(): infinite loop of requests handling
- * algorithm: forever, if there are requests to handle, take the first
- *            and handle it. Then wait on the given condition variable,
- *            and when it is signaled, re-do the loop.
- *            increases number of pending requests by one.
- * input:     id of thread, for printing purposes.
+ * algorithm: forever, find a request and handle it. When there is none
+ *            anywhere, count this worker idle and wait on the condition
+ *            variable until a request is added or the pool closes. A
+ *            worker above the pool's minimum that idles too long retires.
+ * input:     the worker run by this thread.
  * output:    none.
  */
 void *handle_requests_loop(void *args)
 {
-    thread_pool_t *self = (thread_pool_t *)args;
+    thread_pool_worker_t *worker = (thread_pool_worker_t *)args;
+    thread_pool_t *self = worker->pool;
+    current_worker = worker;
 
-    request_t *a_request;
-
-    /* lock the mutex, to access the requests list exclusively. */
-    pthread_mutex_lock(&self->request_mutex);
+    request_t a_request;
+#ifdef THREAD_POOL_METRICS
+    /* Straight on from a request, the end of it stands in for the start of
+       the next, so there is one clock read per request: */
+    bool straight_on = false;
+    worker->last_ns = now_ns();
+#endif
 
     /* while still running.... */
-    int running = 1;
-    while (running)
-    {
-        if (self->num_requests > 0)
-        { /* a request is pending */
-            a_request = get_request(self);
-            if(a_request != NULL)
-            { /* got a request - handle it and free it */
-                /* unlock mutex - so other threads would be able to handle */
-                /* other requests waiting in the queue paralelly.          */
-                pthread_mutex_unlock(&self->request_mutex);
-
-                //TO DO - UNLOCCK MUTEX, CALL FUNCTION TO HANDLE REQUEST AND RELOCK MUTEX
-                // DYNAMIC MEMORY ALLOCATED _ HOW DO WE RECLAIM MEMORY
-                handle_request(a_request);
-
-                free(a_request);
-
-                /* and lock the mutex again. */
-                pthread_mutex_lock(&self->request_mutex);
-            }
-        }
-        else
+    while (!atomic_load(&self->quit))
+    {
+        if (find_request(worker, &a_request))
         {
-            /* wait for a request to arrive. note the mutex will be */
-            /* unlocked here, thus allowing other threads access to */
-            /* requests list.                                       */
+#ifdef THREAD_POOL_METRICS
+            uint64_t start = straight_on ? worker->last_ns : now_ns();
+            handle_request(&a_request);
+            uint64_t end = now_ns();
 
-            pthread_cond_wait(&self->got_request, &self->request_mutex);
-            /* and after we return from pthread_cond_wait, the mutex  */
-            /* is locked again, so we don't need to lock it ourselves */
+            histogram_record(&worker->wait_hist[a_request.priority], start > a_request.enqueued_ns ? start - a_request.enqueued_ns : 0);
+            histogram_record(&worker->run_hist, end - start);
+            add_relaxed(&worker->idle_ns, start - worker->last_ns);
+            add_relaxed(&worker->busy_ns, end - start);
+            worker->last_ns = end;
+            straight_on = true;
+#else
+            handle_request(&a_request);
+#endif
+            continue;
         }
+#ifdef THREAD_POOL_METRICS
+        straight_on = false;
+#endif
 
-        pthread_mutex_lock(&self->quit_mutex);
-        if (self->quit) running = 0;
-        pthread_mutex_unlock(&self->quit_mutex);
+        /* Nothing to do. Count ourselves idle before the last check, so a
+           request added after it is sure to see us and signal: */
+        pthread_mutex_lock(&self->request_mutex);
+        atomic_fetch_add(&self->idle_workers, 1);
+        if (!atomic_load(&self->quit) && !has_request(self))
+        {
+            if (atomic_load(&self->num_threads) > self->min_threads)
+            {
+                struct timespec timeout;
+                clock_gettime(CLOCK_MONOTONIC, &timeout);
+                timeout.tv_sec += THREAD_POOL_IDLE_TIMEOUT_MS / 1000;
+                timeout.tv_nsec += (THREAD_POOL_IDLE_TIMEOUT_MS % 1000) * 1000000L;
+                timeout.tv_sec += timeout.tv_nsec / 1000000000L;
+                timeout.tv_nsec %= 1000000000L;
+
+                if (pthread_cond_timedwait(&self->got_request, &self->request_mutex, &timeout) != 0
+                    && atomic_load(&self->num_threads) > self->min_threads && !has_request(self))
+                { /* Idled out, and still surplus. */
+                    atomic_fetch_sub(&self->idle_workers, 1);
+                    stop_worker(worker);
+                    pthread_mutex_unlock(&self->request_mutex);
+                    current_worker = NULL;
+                    return NULL;
+                }
+            }
+            else
+            {
+                pthread_cond_wait(&self->got_request, &self->request_mutex);
+            }
+        }
+        atomic_fetch_sub(&self->idle_workers, 1);
+        pthread_mutex_unlock(&self->request_mutex);
     }
+
+    pthread_mutex_lock(&self->request_mutex);
+    stop_worker(worker);
     pthread_mutex_unlock(&self->request_mutex);
+
+    current_worker = NULL;
     return NULL;
-}
\ No newline at end of file
+}
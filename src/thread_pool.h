@@ -5,6 +5,8 @@
 #include <stdio.h>   /* standard I/O routines                     */
 #include <pthread.h> /* pthread functions and data structures     */
 #include <stdlib.h>  /* rand() and srand() functions              */
+#include <stdint.h>
+#include <stdatomic.h>
 #include <time.h>
 #include <unistd.h>
 #include <stdbool.h>
@@ -12,25 +14,296 @@
 #include "linked_list.h"
 
 // #define NUM_HANDLER_THREADS 120
+    // Workers of a pool made with thread_pool_init()
 #define NUM_HANDLER_THREADS 5
+    // An elastic pool grows when no worker is idle and more requests than
+    // this are waiting on a shared ring...
+#define THREAD_POOL_SPAWN_DEPTH 8
+    // ...or the oldest one has waited longer than this
+#define THREAD_POOL_SPAWN_WAIT_MS 10
+    // Workers above the minimum retire after idling this long
+#define THREAD_POOL_IDLE_TIMEOUT_MS 2000
+    // Requests each worker's own deque holds, a power of two
+#define THREAD_POOL_DEQUE_SIZE 256
+    // Requests each priority's shared ring holds, a power of two
+#define THREAD_POOL_RING_SIZE 1024
+    // Control requests taken for each simulation request, while both wait
+#define THREAD_POOL_CONTROL_WEIGHT 4
+#define THREAD_POOL_CACHE_LINE 64
+    // Metrics histograms: 2^THREAD_POOL_HIST_SUB_BITS buckets per power of two
+    // (about 6% apart), values of 2^THREAD_POOL_HIST_MAX_BITS ns (about 69 s)
+    // and over all land in the last bucket
+#define THREAD_POOL_HIST_SUB_BITS 4
+#define THREAD_POOL_HIST_MAX_BITS 36
+#define THREAD_POOL_HIST_BUCKETS ((THREAD_POOL_HIST_MAX_BITS - THREAD_POOL_HIST_SUB_BITS + 1) << THREAD_POOL_HIST_SUB_BITS)
 
+typedef void *(*request_func_t)(void *);
+
+/**
+ * @brief Classes of request, most urgent first. Emergency requests are
+ * always taken first, and go ahead of any backlog of the others. Control and
+ * simulation requests share the workers by THREAD_POOL_CONTROL_WEIGHT.
+ */
+typedef enum thread_pool_priority_t
+{
+    THREAD_POOL_EMERGENCY,
+    THREAD_POOL_CONTROL,
+    THREAD_POOL_SIMULATION,     // what thread_pool_add_request() queues
+    THREAD_POOL_PRIORITIES
+} thread_pool_priority_t;
+    // Called with each worker's thread as it is spawned, to pin or name it
+typedef void (*thread_pool_setup_t)(pthread_t thread, size_t index);
+
+/**
+ * @brief Countdown of outstanding work, that threads can wait on to reach
+ * zero. A single futex word: counting down is one atomic operation, plus a
+ * wake only for the last one with someone waiting, and the group may be
+ * freed as soon as a wait on it returns.
+ */
+typedef struct thread_pool_group_t
+{
+    _Atomic uint32_t pending;   // count, with the top bit set once waited on
+} thread_pool_group_t;
+
+/**
+ * @brief A request, for adding a batch of them.
+ */
+typedef struct thread_pool_task_t
+{
+    request_func_t func;
+    void *args;
+} thread_pool_task_t;
+
+/* format of a slot in a worker's deque, read by thieves while the owner writes others. */
+typedef struct request_slot_t
+{
+    _Atomic(request_func_t) func;
+    _Atomic(void *) args;
+    _Atomic(thread_pool_group_t *) group;
+#ifdef THREAD_POOL_METRICS
+    _Atomic uint64_t enqueued_ns;
+#endif
+} request_slot_t;
+
+/* format of a slot in the shared ring. The sequence says whose turn it is:
+   equal to a position, that position's submitter may fill it, one past, that
+   position's worker may empty it. */
+typedef struct ring_slot_t
+{
+    _Atomic size_t sequence;
+    request_func_t func;
+    void *args;
+    thread_pool_group_t *group;
+    _Atomic uint64_t enqueued_ns;   // read early to judge queue wait
+} ring_slot_t;
+
+/**
+ * @brief Bounded multi-producer multi-consumer ring of requests (Vyukov).
+ * Submitters and workers each claim a position with one compare-and-swap,
+ * nothing is allocated.
+ */
+typedef struct request_ring_t
+{
+    _Alignas(THREAD_POOL_CACHE_LINE) _Atomic size_t enqueue_pos;
+    _Alignas(THREAD_POOL_CACHE_LINE) _Atomic size_t dequeue_pos;
+    _Alignas(THREAD_POOL_CACHE_LINE) ring_slot_t slots[THREAD_POOL_RING_SIZE];
+} request_ring_t;
+
+/**
+ * @brief Log-linear (HDR style) histogram of durations in nanoseconds.
+ * Only its worker writes it, so counts are plain relaxed stores, never
+ * read-modify-writes, and snapshots read it without locking.
+ */
+typedef struct thread_pool_histogram_t
+{
+    _Atomic uint64_t counts[THREAD_POOL_HIST_BUCKETS];
+    _Atomic uint64_t max;
+} thread_pool_histogram_t;
+
+/**
+ * @brief A worker's own deque of requests (Chase-Lev). The worker pushes
+ * and takes at the bottom, other workers steal from the top.
+ */
+typedef struct thread_pool_worker_t
+{
+    _Atomic int64_t top;
+    _Atomic int64_t bottom;
+    request_slot_t slots[THREAD_POOL_DEQUE_SIZE];
+
+    struct thread_pool_t *pool;
+    size_t index;
+    pthread_t thread;
+    bool running;   // a thread runs this worker, changed under the request mutex
+    size_t turn;    // control and simulation requests taken, to weight them
+
+#ifdef THREAD_POOL_METRICS
+    thread_pool_histogram_t wait_hist[THREAD_POOL_PRIORITIES]; // submission to start of each request
+    thread_pool_histogram_t run_hist;   // start to end of each request
+    _Atomic uint64_t busy_ns;
+    _Atomic uint64_t idle_ns;
+    uint64_t last_ns;                   // end of its last request, or its start
+#endif
+} thread_pool_worker_t;
+
+/**
+ * @brief Work stealing thread pool with priorities. Simulation requests
+ * added from a worker go on that worker's deque, every other request goes
+ * on the shared ring of its priority. Idle workers take emergency requests
+ * first, then control requests or their own deque and the simulation ring,
+ * by weight, then steal from the other workers, and only sleep when all are
+ * empty. Adding a request never allocates.
+ *
+ * Requests run to completion, so an emergency request starts at the latest
+ * once a worker finishes the request it is running, however many others
+ * are queued. An elastic pool also spawns a worker for it if none is idle.
+ *
+ * The number of workers can change between a minimum and a maximum: a
+ * worker is spawned when requests queue up with no worker idle, and workers
+ * above the minimum retire after idling for THREAD_POOL_IDLE_TIMEOUT_MS.
+ */
 typedef struct thread_pool_t
 {
-    pthread_t p_threads[NUM_HANDLER_THREADS];
+    thread_pool_worker_t *workers;    // max_threads of them
+    size_t min_threads;
+    size_t max_threads;
+    _Atomic size_t num_threads;       // workers running
+    pthread_t supervisor;             // spawns for stuck requests, if elastic
+    thread_pool_setup_t thread_setup; // NULL for none, changed under the request mutex
 
-    list_t request_list;
+    request_ring_t requests[THREAD_POOL_PRIORITIES];
     pthread_mutex_t request_mutex;
-    pthread_mutex_t quit_mutex;
     pthread_cond_t got_request;
+    pthread_cond_t not_full;
+    pthread_cond_t workers_changed;   // a worker stopped, or the pool is closing
 
-    size_t num_requests;
-    bool quit;
+    _Atomic int idle_workers;     // sleeping, or about to, on got_request
+    _Atomic int full_waiters;     // submitters sleeping, or about to, on not_full
+    _Atomic bool quit;
 } thread_pool_t;
 
+/**
+ * @brief Percentiles of a duration, in nanoseconds. Each is the top of the
+ * histogram bucket it falls in, so at most about 6% high.
+ */
+typedef struct thread_pool_percentiles_t
+{
+    uint64_t p50;
+    uint64_t p90;
+    uint64_t p99;
+    uint64_t p999;
+    uint64_t max;
+} thread_pool_percentiles_t;
+
+/**
+ * @brief Snapshot of a pool's metrics, summed over every worker.
+ */
+typedef struct thread_pool_metrics_t
+{
+    uint64_t requests;                  // taken off the queues and handled so far
+    thread_pool_percentiles_t wait;     // time queued before starting
+    uint64_t requests_by_priority[THREAD_POOL_PRIORITIES];
+    thread_pool_percentiles_t wait_by_priority[THREAD_POOL_PRIORITIES];
+    thread_pool_percentiles_t run;      // time running, including any run inline
+    uint64_t busy_ns;                   // running requests
+    uint64_t idle_ns;                   // looking for, or waiting on, requests
+    double utilisation;                 // busy_ns / (busy_ns + idle_ns)
+} thread_pool_metrics_t;
+
+/**
+ * @brief Start a pool of NUM_HANDLER_THREADS workers.
+ */
 void thread_pool_init(thread_pool_t *self);
 
+/**
+ * @brief Start a pool of min_threads workers, that can grow to max_threads.
+ *
+ * @returns false if out of memory or max_threads is 0.
+ */
+bool thread_pool_init_sized(thread_pool_t *self, size_t min_threads, size_t max_threads);
+
+/**
+ * @brief Stop every worker once it finishes its current request and join them.
+ * Requests still queued are dropped.
+ */
 void thread_pool_close(thread_pool_t *self);
 
+/**
+ * @brief Queue a simulation request, waiting for room if the shared ring is
+ * full. On a worker of this pool with every queue full, the request is run
+ * right away instead, as waiting could deadlock the pool.
+ */
 void thread_pool_add_request(thread_pool_t *self, void *(*func)(void *), void *args);
 
-#endif //THREAD_POOL
\ No newline at end of file
+/**
+ * @brief Queue a request of the given priority, as thread_pool_add_request().
+ */
+void thread_pool_add_request_priority(thread_pool_t *self, thread_pool_priority_t priority,
+    void *(*func)(void *), void *args);
+
+/**
+ * @brief Queue a batch of requests of the given priority, claiming room for
+ * as many as fit with one atomic operation and waking workers once, and
+ * waiting for room for the rest as thread_pool_add_request().
+ *
+ * @param group If not NULL, counted up by n here and down as each request
+ * finishes. Requests dropped by thread_pool_close() are never counted down.
+ */
+void thread_pool_add_batch(thread_pool_t *self, thread_pool_priority_t priority,
+    const thread_pool_task_t *tasks, size_t n, thread_pool_group_t *group);
+
+/**
+ * @brief Queue a simulation request if there is room.
+ *
+ * @returns false, without queueing, if the queue it would go on is full.
+ */
+bool thread_pool_try_add_request(thread_pool_t *self, void *(*func)(void *), void *args);
+
+/**
+ * @brief Queue a request of the given priority if there is room.
+ */
+bool thread_pool_try_add_request_priority(thread_pool_t *self, thread_pool_priority_t priority,
+    void *(*func)(void *), void *args);
+
+/**
+ * @brief Initialise a group with nothing pending.
+ */
+void thread_pool_group_init(thread_pool_group_t *group);
+
+/**
+ * @brief Count n more pieces of work pending.
+ */
+void thread_pool_group_add(thread_pool_group_t *group, size_t n);
+
+/**
+ * @brief Count one piece of work finished, waking the waiters if it was the last.
+ */
+void thread_pool_group_done(thread_pool_group_t *group);
+
+/**
+ * @brief Wait until nothing is pending.
+ */
+void thread_pool_group_wait(thread_pool_group_t *group);
+
+/**
+ * @brief Number of workers running right now.
+ */
+size_t thread_pool_num_threads(thread_pool_t *self);
+
+/**
+ * @brief Call setup with the thread of every worker running, and of every
+ * worker spawned from now on. Its index is the worker's, below max_threads.
+ */
+void thread_pool_set_thread_setup(thread_pool_t *self, thread_pool_setup_t setup);
+
+/**
+ * @brief Snapshot the pool's metrics while it runs. Busy and idle time are
+ * counted up to each worker's last request. A worker going straight from one
+ * request to the next counts the time it took to find it as running time.
+ * Requests a worker runs inline, as every queue was full, are counted as
+ * part of the request that added them.
+ *
+ * @returns false, leaving metrics untouched, if not built with THREAD_POOL_METRICS.
+ */
+bool thread_pool_metrics(thread_pool_t *self, thread_pool_metrics_t *metrics);
+
+#endif //THREAD_POOL
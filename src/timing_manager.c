@@ -0,0 +1,336 @@
+#include <time.h>
+#include <string.h>
+#include "timing_manager.h"
+
+#define SLOT_MASK (TIMING_MANAGER_SLOTS - 1)
+
+static void *timing_manager_loop(void *args);
+
+/**
+ * @brief Ticks since the manager started, rounded down.
+ */
+static uint64_t current_tick(timing_manager_t *self)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    int64_t ns = (int64_t)(now.tv_sec - self->start.tv_sec) * 1000000000 + (now.tv_nsec - self->start.tv_nsec);
+    return (uint64_t)ns / (TIMING_MANAGER_TICK_MS * 1000000);
+}
+
+/**
+ * @brief Distance, 1 to TIMING_MANAGER_SLOTS, from slot `from` to the next
+ * occupied slot of a wheel going round. 0 if the wheel is empty.
+ */
+static unsigned next_occupied(const uint64_t occupied[TIMING_MANAGER_SLOTS / 64], unsigned from)
+{
+    unsigned start = (from + 1) & SLOT_MASK;
+    for(unsigned scanned = 0; scanned < TIMING_MANAGER_SLOTS;)
+    {
+        unsigned pos = (start + scanned) & SLOT_MASK;
+        uint64_t bits = occupied[pos / 64] >> (pos % 64);
+        if(bits != 0)
+        {
+            return scanned + __builtin_ctzll(bits) + 1;
+        }
+        scanned += 64 - pos % 64;
+    }
+    return 0;
+}
+
+/**
+ * @brief List a task in the wheel slot for its expiry: the finest wheel
+ * that reaches it without going all the way round.
+ */
+static void wheel_insert(timing_manager_t *self, timing_task_t *task)
+{
+    unsigned level = 0, slot = 0;
+    for(; level < TIMING_MANAGER_LEVELS; ++level)
+    {
+        unsigned shift = level * TIMING_MANAGER_SLOT_BITS;
+        if((task->expires >> shift) - (self->now >> shift) < TIMING_MANAGER_SLOTS)
+        {
+            slot = (task->expires >> shift) & SLOT_MASK;
+            break;
+        }
+    }
+    if(level == TIMING_MANAGER_LEVELS)
+    { /* Beyond the coarsest wheel, park it in its furthest slot and place it again from there. */
+        level = TIMING_MANAGER_LEVELS - 1;
+        slot = ((self->now >> (level * TIMING_MANAGER_SLOT_BITS)) + SLOT_MASK) & SLOT_MASK;
+    }
+
+    timing_task_t **head = &self->slots[level][slot];
+    task->previous = NULL;
+    task->next = *head;
+    if(*head != NULL)
+    {
+        (*head)->previous = task;
+    }
+    *head = task;
+    self->occupied[level][slot / 64] |= UINT64_C(1) << (slot % 64);
+
+    task->wheel_slot = level * TIMING_MANAGER_SLOTS + slot;
+    task->pending = true;
+}
+
+static void wheel_remove(timing_manager_t *self, timing_task_t *task)
+{
+    unsigned level = task->wheel_slot / TIMING_MANAGER_SLOTS;
+    unsigned slot = task->wheel_slot % TIMING_MANAGER_SLOTS;
+
+    if(task->previous != NULL)
+    {
+        task->previous->next = task->next;
+    }
+    else
+    {
+        self->slots[level][slot] = task->next;
+    }
+    if(task->next != NULL)
+    {
+        task->next->previous = task->previous;
+    }
+
+    if(self->slots[level][slot] == NULL)
+    {
+        self->occupied[level][slot / 64] &= ~(UINT64_C(1) << (slot % 64));
+    }
+    task->pending = false;
+}
+
+/**
+ * @brief Take every task out of a slot, returning them as a list.
+ */
+static timing_task_t *wheel_take_slot(timing_manager_t *self, unsigned level, unsigned slot)
+{
+    timing_task_t *tasks = self->slots[level][slot];
+    self->slots[level][slot] = NULL;
+    self->occupied[level][slot / 64] &= ~(UINT64_C(1) << (slot % 64));
+    return tasks;
+}
+
+/**
+ * @brief Process ticks up to target, moving tasks down to finer wheels as
+ * their slots come round. Expired tasks are taken off the wheels and
+ * returned through *fired, linked by `next`.
+ */
+static void wheel_advance(timing_manager_t *self, uint64_t target, timing_task_t **fired)
+{
+    while(self->now < target)
+    {
+        bool fine_empty = true;
+        for(unsigned w = 0; w < TIMING_MANAGER_SLOTS / 64; ++w)
+        {
+            fine_empty = fine_empty && self->occupied[0][w] == 0;
+        }
+        if(fine_empty)
+        { /* Nothing can expire before the finest wheel's next turn, skip to it. */
+            uint64_t turn = (self->now | SLOT_MASK) + 1;
+            if(turn > target)
+            {
+                self->now = target;
+                break;
+            }
+            self->now = turn - 1;
+        }
+
+        ++self->now;
+
+        /* Coarsest first, so tasks moved down are moved again if their new slot is also due: */
+        for(unsigned level = TIMING_MANAGER_LEVELS - 1; level > 0; --level)
+        {
+            unsigned shift = level * TIMING_MANAGER_SLOT_BITS;
+            if((self->now & ((UINT64_C(1) << shift) - 1)) != 0)
+            {
+                continue;
+            }
+
+            timing_task_t *task = wheel_take_slot(self, level, (self->now >> shift) & SLOT_MASK);
+            while(task != NULL)
+            {
+                timing_task_t *next = task->next;
+                wheel_insert(self, task);
+                task = next;
+            }
+        }
+
+        timing_task_t *task = wheel_take_slot(self, 0, self->now & SLOT_MASK);
+        while(task != NULL)
+        {
+            timing_task_t *next = task->next;
+            task->pending = false;
+            task->next = *fired;
+            *fired = task;
+            --self->num_tasks;
+            task = next;
+        }
+    }
+}
+
+/**
+ * @brief Tick the thread must next wake on: when the next occupied slot of
+ * any wheel comes round. UINT64_MAX if there are no tasks.
+ */
+static uint64_t wheel_next_wake(timing_manager_t *self)
+{
+    uint64_t wake = UINT64_MAX;
+    for(unsigned level = 0; level < TIMING_MANAGER_LEVELS; ++level)
+    {
+        unsigned shift = level * TIMING_MANAGER_SLOT_BITS;
+        unsigned distance = next_occupied(self->occupied[level], (self->now >> shift) & SLOT_MASK);
+        if(distance != 0)
+        {
+            uint64_t tick = ((self->now >> shift) + distance) << shift;
+            wake = tick < wake ? tick : wake;
+        }
+    }
+    return wake;
+}
+
+void timing_manager_init(timing_manager_t *self, thread_pool_t *pool)
+{
+    memset(self->slots, 0, sizeof(self->slots));
+    memset(self->occupied, 0, sizeof(self->occupied));
+    self->now = 0;
+    self->wake = UINT64_MAX;
+    clock_gettime(CLOCK_MONOTONIC, &self->start);
+    self->num_tasks = 0;
+    self->pool = pool;
+    self->quit = false;
+
+    pthread_condattr_t cond_attr;
+    pthread_condattr_init(&cond_attr);
+    pthread_condattr_setclock(&cond_attr, CLOCK_MONOTONIC);
+    pthread_mutex_init(&self->mutex, NULL);
+    pthread_cond_init(&self->changed, &cond_attr);
+    pthread_condattr_destroy(&cond_attr);
+
+    pthread_create(&self->thread, NULL, timing_manager_loop, self);
+}
+
+void timing_manager_close(timing_manager_t *self)
+{
+    pthread_mutex_lock(&self->mutex);
+    self->quit = true;
+    pthread_cond_signal(&self->changed);
+    pthread_mutex_unlock(&self->mutex);
+
+    pthread_join(self->thread, NULL);
+    pthread_mutex_destroy(&self->mutex);
+    pthread_cond_destroy(&self->changed);
+}
+
+void timing_manager_add(timing_manager_t *self, timing_task_t *task, uint64_t delay_ms,
+    void *(*func)(void *), void *args)
+{
+    uint64_t delay = (delay_ms + TIMING_MANAGER_TICK_MS - 1) / TIMING_MANAGER_TICK_MS;
+    if(delay > TIMING_MANAGER_MAX_DELAY)
+    {
+        delay = TIMING_MANAGER_MAX_DELAY;
+    }
+    task->func = func;
+    task->args = args;
+
+    pthread_mutex_lock(&self->mutex);
+
+    /* The current slot may already be processed, the earliest is the next one: */
+    task->expires = current_tick(self) + delay;
+    if(task->expires <= self->now)
+    {
+        task->expires = self->now + 1;
+    }
+    wheel_insert(self, task);
+    ++self->num_tasks;
+
+    /* Wake the thread early if this is due before it would wake: */
+    if(task->expires < self->wake)
+    {
+        pthread_cond_signal(&self->changed);
+    }
+
+    pthread_mutex_unlock(&self->mutex);
+}
+
+bool timing_manager_cancel(timing_manager_t *self, timing_task_t *task)
+{
+    pthread_mutex_lock(&self->mutex);
+    bool cancelled = task->pending;
+    if(cancelled)
+    {
+        wheel_remove(self, task);
+        --self->num_tasks;
+    }
+    pthread_mutex_unlock(&self->mutex);
+
+    return cancelled;
+}
+
+/**
+ * @brief Thread of a timing manager. Processes the ticks that have passed,
+ * hands expired tasks over without holding the mutex, then sleeps until
+ * the next occupied slot is due or a task is added before it.
+ */
+static void *timing_manager_loop(void *args)
+{
+    timing_manager_t *self = (timing_manager_t *)args;
+
+    pthread_mutex_lock(&self->mutex);
+    while(!self->quit)
+    {
+        timing_task_t *fired = NULL;
+        wheel_advance(self, current_tick(self), &fired);
+        if(fired != NULL)
+        {
+            self->wake = 0; /* Busy, adds needn't signal. */
+            pthread_mutex_unlock(&self->mutex);
+            /* Handed to the pool a batch at a time, one wake per batch. The
+               task may be reused as soon as its function starts: */
+            thread_pool_task_t batch[TIMING_MANAGER_BATCH];
+            size_t batched = 0;
+            while(fired != NULL)
+            {
+                timing_task_t *next = fired->next;
+                if(self->pool != NULL)
+                {
+                    batch[batched].func = fired->func;
+                    batch[batched].args = fired->args;
+                    if(++batched == TIMING_MANAGER_BATCH)
+                    {
+                        thread_pool_add_batch(self->pool, THREAD_POOL_SIMULATION, batch, batched, NULL);
+                        batched = 0;
+                    }
+                }
+                else
+                {
+                    fired->func(fired->args);
+                }
+                fired = next;
+            }
+            if(batched > 0)
+            {
+                thread_pool_add_batch(self->pool, THREAD_POOL_SIMULATION, batch, batched, NULL);
+            }
+            pthread_mutex_lock(&self->mutex);
+            continue;
+        }
+
+        self->wake = wheel_next_wake(self);
+        if(self->wake == UINT64_MAX)
+        {
+            pthread_cond_wait(&self->changed, &self->mutex);
+        }
+        else
+        {
+            uint64_t wake_ms = self->wake * TIMING_MANAGER_TICK_MS;
+            struct timespec deadline = self->start;
+            deadline.tv_sec += wake_ms / 1000;
+            deadline.tv_nsec += (wake_ms % 1000) * 1000000L;
+            deadline.tv_sec += deadline.tv_nsec / 1000000000L;
+            deadline.tv_nsec %= 1000000000L;
+            pthread_cond_timedwait(&self->changed, &self->mutex, &deadline);
+        }
+    }
+    pthread_mutex_unlock(&self->mutex);
+
+    return NULL;
+}
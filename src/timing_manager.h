@@ -1,44 +1,87 @@
 #ifndef  TIMING_MANGER_H
 #define  TIMING_MANGER_H
 
-#include <unistd.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include "thread_pool.h"
+
+    // Length of one tick of the wheels, the resolution of every delay
+#define TIMING_MANAGER_TICK_MS 1
+    // Wheels, each TIMING_MANAGER_SLOTS times coarser than the last
+#define TIMING_MANAGER_LEVELS 4
+#define TIMING_MANAGER_SLOT_BITS 8
+#define TIMING_MANAGER_SLOTS (1 << TIMING_MANAGER_SLOT_BITS)
+    // Longest delay, in ticks (about 49 days), longer ones are cut to it
+#define TIMING_MANAGER_MAX_DELAY ((UINT64_C(1) << (TIMING_MANAGER_LEVELS * TIMING_MANAGER_SLOT_BITS)) - 1)
+    // Expired tasks handed to the pool in one submission
+#define TIMING_MANAGER_BATCH 64
+
+/**
+ * @brief A delayed function. The caller owns the memory, which must stay
+ * valid until the function has started or the task is cancelled, so any
+ * number of timers can be outstanding without allocating.
+ */
+typedef struct timing_task_t
+{
+    struct timing_task_t *previous;
+    struct timing_task_t *next;
+    uint64_t expires;       // tick it is due on
+    void *(*func)(void *);
+    void *args;
+    uint16_t wheel_slot;    // level * TIMING_MANAGER_SLOTS + slot it is listed in
+    bool pending;           // on a wheel, changed under the manager's mutex
+} timing_task_t;
+
+/**
+ * @brief Runs functions after a delay, using hierarchical timing wheels.
+ * Adding and cancelling are O(1): a task is listed in the slot of the wheel
+ * whose range covers its delay, and moved down to a finer wheel when that
+ * slot comes round. One thread sleeps until the next slot with tasks is due,
+ * then hands the expired functions to a thread pool.
+ */
+typedef struct timing_manager_t
+{
+    timing_task_t *slots[TIMING_MANAGER_LEVELS][TIMING_MANAGER_SLOTS];
+    uint64_t occupied[TIMING_MANAGER_LEVELS][TIMING_MANAGER_SLOTS / 64]; // bit per non-empty slot
+
+    uint64_t now;           // last tick processed
+    uint64_t wake;          // tick the thread sleeps until, UINT64_MAX if no tasks
+    struct timespec start;  // time of tick 0
+    size_t num_tasks;
+
+    thread_pool_t *pool;
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t changed;
+    bool quit;
+} timing_manager_t;
 
 /**
- * @brief Initialise timing manager. Requires a function pointer to
- * register delayed functions to a thread pool, to run once delay has expired.
- * 
- * @param thread_pool_register function pointer to the register of a thread pool queue.
- * Takes a void pointer argument and returns void.
- * 
- * @returns Void.
+ * @brief Initialise a timing manager and start its thread.
+ *
+ * @param pool Thread pool to run expired functions on, or NULL to run
+ * them on the manager's thread (they must be short).
  */
-void timing_manager_init(void (*thread_pool_register)(void (*func)(void *), void *));
+void timing_manager_init(timing_manager_t *self, thread_pool_t *pool);
 
 /**
- * @brief Use to register a function and its delay to the timing manager list.
- * 
- * @param
- * @param
- * 
- * @returns
+ * @brief Stop the manager's thread. Tasks that have not expired are dropped.
  */
-void timing_manager_register_function();
+void timing_manager_close(timing_manager_t *self);
 
 /**
- * @brief Responsible for calling registered functions after a specified delay.
- * Uses a linked list, containing registered functions, and services them in
- * FIFO order.
- * 
- * @returns Void.
+ * @brief Run func(args) once delay_ms have passed. The task must not be pending.
  */
-void timing_manager_loop(void);
+void timing_manager_add(timing_manager_t *self, timing_task_t *task, uint64_t delay_ms,
+    void *(*func)(void *), void *args);
 
 /**
- * @brief Call to stop timing manager. Must be called from another thread
- * as `timing_manager_loop` operates in an infinite loop.
+ * @brief Cancel a task.
  *
- * @returns Void.
+ * @returns true if it was cancelled, false if its function has been (or is
+ * being) handed over to run.
  */
-void stop_timing_manager(void);
+bool timing_manager_cancel(timing_manager_t *self, timing_task_t *task);
 
-#endif //TIMING_MANGER_H
\ No newline at end of file
+#endif //TIMING_MANGER_H
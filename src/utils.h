@@ -5,6 +5,7 @@
 #include <pthread.h>
 #include <stdio.h>
 #include "htab.h"
+#include "plate_loader.h"
 #include "shared_memory.h"
 
 //////////////////// Randomisation functionality:
@@ -63,27 +64,24 @@ void delay_random_ms(pthread_mutex_t *mutex, unsigned int range_min, unsigned in
 
 //////////////////// File I/O functionality:
 
-// Setup License plate for reading
-void lp_list ( htab_t *htable, char auth_lplates[][LICENSE_PLATE_LENGTH + 1] ) {
-
-    FILE *plate = fopen("plates.txt", "r");
+#define AUTH_PLATES_FILE "plates.txt"
 
-    const unsigned MAX_LENGTH = 256;
-    char buffer[LICENSE_PLATE_LENGTH + 1];
+// Setup License plate for reading
+    // Loads every plate in plates.txt into the arena, then initialises the
+    // hash table with them. Plate i of the arena has the value i + 1.
+bool lp_list ( htab_t *htable, plate_arena_t *auth_lplates ) {
 
-    /* Each line contains one license plate string: */
-    size_t line;
+    if (!plate_arena_init(auth_lplates, TOTAL_CAPACITY)) {
+        return false;
+    }
 
-    // Assign authorised license plates to Hash Table
-    while (fgets(buffer, MAX_LENGTH, plate)) {
-        strcpy(auth_lplates[line], buffer);
-        auth_lplates[line][LICENSE_PLATE_LENGTH] = '\0';
-        htab_add(htable, auth_lplates[line], line+1);
-        line++;
+    // Read authorised license plates, in parallel for big files
+    if (!plate_load_file(AUTH_PLATES_FILE, auth_lplates, PLATE_LOADER_THREADS)) {
+        return false;
     }
 
-    // close the file
-    fclose(plate);
+    // Assign authorised license plates to Hash Table
+    return plate_arena_build_htab(auth_lplates, htable);
 }
 
 //////////////////// End file I/O functionality.